@@ -0,0 +1,345 @@
+/**
+ * @file bench_context.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief throughput and latency of the closure hot paths.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Built once per allocator (see bench/Makefile) so the results of
+ *  the static pool and USE_MALLOC builds can be compared.  Each result is
+ *  one JSON object per line on stdout:
+ * 
+ *  {"build":"static","bench":"package_free","case":"fixed","ops":1000000,"ns_per_op":21.4}
+ * 
+ *  Latency results add p50/p90/p99/max in nanoseconds.
+ */
+#define _GNU_SOURCE
+#include "context.h"
+#include "context_queue.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef USE_MALLOC
+#define BUILD "malloc"
+#else
+#define BUILD "static"
+#endif
+
+#ifndef BENCH_OPS
+#define BENCH_OPS 1000000
+#endif
+
+#define LATENCY_SAMPLES 100000
+#define PRODUCERS 3
+
+struct params_t
+{
+    uint32_t a, b, c;
+};
+
+static volatile uint32_t sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void report(const char *bench, const char *which, long ops, uint64_t ns)
+{
+    printf("{\"build\":\"%s\",\"bench\":\"%s\",\"case\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.2f}\n",
+           BUILD, bench, which, ops, (double)ns / (double)ops);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void report_latency(const char *bench, const char *which, uint64_t *samples, long n, long failures)
+{
+    qsort(samples, (size_t)n, sizeof *samples, cmp_u64);
+    printf("{\"build\":\"%s\",\"bench\":\"%s\",\"case\":\"%s\",\"ops\":%ld,\"failures\":%ld,"
+           "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}\n",
+           BUILD, bench, which, n, failures,
+           (unsigned long long)samples[n / 2], (unsigned long long)samples[n * 9 / 10],
+           (unsigned long long)samples[n * 99 / 100], (unsigned long long)samples[n - 1]);
+}
+
+static void sum_func(context_blk_t *context)
+{
+    struct params_t *p = (struct params_t*)context->user_context;
+    sink += p->a + p->b + p->c;
+}
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * @brief package and free straight away, one size
+ */
+static void bench_package_free_fixed(void)
+{
+    struct params_t p = {1,2,3};
+    uint64_t start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        free_context_blk(package_context(sum_func, &p, sizeof p, 0));
+    }
+    report("package_free", "fixed", BENCH_OPS, now_ns() - start);
+}
+
+#ifdef USE_MALLOC
+#define FREELIST_CLASSES 64     // 16 byte classes, up to 1k
+
+static void *freelist[FREELIST_CLASSES];
+
+// a sized heap: the size given to free picks the list, no header lookup
+static void *freelist_alloc(size_t size)
+{
+    size_t c = size / CONTEXT_HEAP_ALIGN;
+    if(c < FREELIST_CLASSES && freelist[c])
+    {
+        void *p = freelist[c];
+        freelist[c] = *(void**)p;
+        return p;
+    }
+    return malloc(size);
+}
+
+static void freelist_free(void *ptr, size_t size)
+{
+    size_t c = size / CONTEXT_HEAP_ALIGN;
+    if(c < FREELIST_CLASSES)
+    {
+        *(void**)ptr = freelist[c];
+        freelist[c] = ptr;
+        return;
+    }
+    free(ptr);
+}
+
+/**
+ * @brief the fixed case again from a static pool and through a sized heap
+ *  hook, to compare with the default heap in the same binary
+ */
+static void bench_heap_alternatives(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, 64) / sizeof(uint64_t)];
+    context_pool_t pool;
+    struct params_t p = {1,2,3};
+
+    context_pool_init(&pool, memory, 128, 64);
+    uint64_t start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        free_context_blk(package_context_in(&pool, sum_func, &p, sizeof p, 0));
+    }
+    report("package_free", "fixed_static_pool", BENCH_OPS, now_ns() - start);
+    context_pool_deinit(&pool);
+
+    context_set_heap(freelist_alloc, freelist_free);
+    start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        free_context_blk(package_context(sum_func, &p, sizeof p, 0));
+    }
+    report("package_free", "fixed_sized_hook", BENCH_OPS, now_ns() - start);
+    context_set_heap(NULL, NULL);
+}
+#endif
+
+/**
+ * @brief keep a window of live closures of mixed size and free them out of
+ *  order, which leaves holes between the survivors
+ * 
+ * @param which name of the case
+ * @param live closures held at once
+ * @param sizes workspace sizes to choose from
+ * @param n_sizes entries in sizes
+ */
+static void bench_package_free_mix(const char *which, int live, const size_t *sizes, int n_sizes)
+{
+    struct params_t p = {1,2,3};
+    context_blk_t *window[64] = {0};
+    long ops = 0;
+    uint64_t start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        int slot = (int)(rng() % (uint32_t)live);
+        if(window[slot])
+        {
+            free_context_blk(window[slot]);
+        }
+        window[slot] = package_context(sum_func, &p, sizeof p, sizes[rng() % (uint32_t)n_sizes]);
+        ops += window[slot] != NULL;
+    }
+    uint64_t ns = now_ns() - start;
+    for(int i=0; i<live; i++)
+    {
+        if(window[i])
+        {
+            free_context_blk(window[i]);
+        }
+    }
+    report("package_free", which, ops, ns);
+}
+
+/**
+ * @brief latency of one package_context() with most of the pool taken by
+ *  scattered single blocks
+ */
+static void bench_near_full_latency(void)
+{
+    static uint64_t samples[LATENCY_SAMPLES];
+    struct params_t p = {1,2,3};
+    context_blk_t *held[1024];
+    int n_held = 0;
+    context_blk_t *blk;
+    // fill, then give back every fourth block so the free space is fragmented
+    while(n_held < 1024 && (blk = package_context(sum_func, &p, sizeof p, 0)) != NULL)
+    {
+        held[n_held++] = blk;
+    }
+    for(int i=0; i<n_held; i+=4)
+    {
+        free_context_blk(held[i]);
+        held[i] = NULL;
+    }
+    long failures = 0;
+    for(long i=0; i<LATENCY_SAMPLES; i++)
+    {
+        uint64_t start = now_ns();
+        blk = package_context(sum_func, &p, sizeof p, 0);
+        samples[i] = now_ns() - start;
+        if(blk)
+        {
+            free_context_blk(blk);
+        }
+        else
+        {
+            failures++;
+        }
+    }
+    for(int i=0; i<n_held; i++)
+    {
+        if(held[i])
+        {
+            free_context_blk(held[i]);
+        }
+    }
+    report_latency("package_latency", "near_full", samples, LATENCY_SAMPLES, failures);
+}
+
+/**
+ * @brief cost of run_context() against calling the function directly
+ */
+static void bench_dispatch(void)
+{
+    struct params_t p = {1,2,3};
+    context_blk_t *blk = package_context(sum_func, &p, sizeof p, 0);
+    void (*volatile direct)(context_blk_t*) = sum_func;  // keep the call indirect
+    uint64_t start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        direct(blk);
+    }
+    report("dispatch", "direct", BENCH_OPS, now_ns() - start);
+    start = now_ns();
+    for(long i=0; i<BENCH_OPS; i++)
+    {
+        run_context(blk);
+    }
+    report("dispatch", "run_context", BENCH_OPS, now_ns() - start);
+    free_context_blk(blk);
+}
+
+#if defined(CONTEXT_LOCKFREE) || defined(USE_MALLOC)
+static ctx_queue_t queue;
+static atomic_int producers_done;
+
+static void *producer(void *arg)
+{
+    struct params_t p = {1,2,3};
+    long count = (long)(intptr_t)arg;
+    for(long i=0; i<count; i++)
+    {
+        context_blk_t *blk;
+        while((blk = package_context(sum_func, &p, sizeof p, 0)) == NULL)
+        {
+            sched_yield();  // pool empty, consumer is behind
+        }
+        while(!ctx_queue_push(&queue, blk))
+        {
+            sched_yield();
+        }
+    }
+    atomic_fetch_add(&producers_done, 1);
+    return NULL;
+}
+
+/**
+ * @brief producers package and queue closures, one consumer runs and
+ *  frees them
+ */
+static void bench_producer_consumer(void)
+{
+    pthread_t threads[PRODUCERS];
+    const long per_producer = BENCH_OPS / PRODUCERS;
+    ctx_queue_init(&queue, CTX_QUEUE_MPSC);
+    atomic_init(&producers_done, 0);
+    uint64_t start = now_ns();
+    for(int i=0; i<PRODUCERS; i++)
+    {
+        pthread_create(&threads[i], NULL, producer, (void*)(intptr_t)per_producer);
+    }
+    long ran = 0;
+    while(ran < per_producer * PRODUCERS)
+    {
+        size_t n = ctx_queue_drain(&queue, run_context_and_free);
+        ran += (long)n;
+        if(n == 0)
+        {
+            sched_yield();
+        }
+    }
+    uint64_t ns = now_ns() - start;
+    for(int i=0; i<PRODUCERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    report("producer_consumer", "mpsc_3x1", ran, ns);
+}
+#endif
+
+int main(void)
+{
+    static const size_t small[] = {0, 16, 64};
+    static const size_t mixed[] = {0, 100, 300, 700, 1500};
+
+    bench_package_free_fixed();
+#ifdef USE_MALLOC
+    bench_heap_alternatives();
+#endif
+    bench_package_free_mix("small_mix_live8", 8, small, 3);
+    bench_package_free_mix("mixed_live16", 16, mixed, 5);
+    bench_package_free_mix("mixed_live48", 48, mixed, 5);
+    bench_near_full_latency();
+    bench_dispatch();
+#if defined(CONTEXT_LOCKFREE) || defined(USE_MALLOC)
+    bench_producer_consumer();
+#endif
+    return 0;
+}
@@ -12,153 +12,1717 @@
 #include <assert.h>
 #include <string.h>
 
+#ifdef CONTEXT_COROUTINE
+#include "context_coro.h"
+#endif
+#ifdef CONTEXT_TRACE
+#include "context_trace.h"
+// the size is taken before the call, the closure may free itself
+#define TRACE_BEGIN(blk) uint32_t trace_size = (uint32_t)(blk)->size; uint32_t trace_start = ctx_trace_begin()
+#define TRACE_END(func) ctx_trace_end((func), trace_size, trace_start)
+#else
+#define TRACE_BEGIN(blk)
+#define TRACE_END(func)
+#endif
+
+#ifdef CONTEXT_COMPLETION
+static void complete(context_blk_t *blk);
+#define COMPLETE(blk) complete(blk)
+#ifndef CONTEXT_WAIT_PAUSE
+#if defined(CONTEXT_WAIT_YIELD)
+#include <sched.h>
+#define CONTEXT_WAIT_PAUSE() sched_yield()
+#elif defined(__x86_64__) || defined(__i386__)
+#define CONTEXT_WAIT_PAUSE() __builtin_ia32_pause()
+#elif defined(__arm__) || defined(__aarch64__)
+#define CONTEXT_WAIT_PAUSE() __asm__ volatile("yield")
+#else
+#define CONTEXT_WAIT_PAUSE() ((void)0)
+#endif
+#endif
+#else
+#define COMPLETE(blk)
+#endif
+
+/*
+    With CONTEXT_LOCKFREE the pool bookkeeping is C11 atomics and every update
+    is a single CAS or fetch-and, so package_context() and free_context_blk()
+    may be called from interrupts and from other cores without a critical
+    section.  The target needs native atomic read-modify-write of 32 bits
+    (LDREX/STREX on Cortex-M3 and up).  Without it the same code runs on
+    plain variables for single context use.
+*/
+#ifdef CONTEXT_LOCKFREE
+#include <stdatomic.h>
+#define SHARED(T) _Atomic T
+#define load_shared(p) atomic_load_explicit((p), memory_order_acquire)
+#define store_shared(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#define cas_shared(p, expect, desired) \
+    atomic_compare_exchange_weak_explicit((p), (expect), (desired), memory_order_acq_rel, memory_order_acquire)
+#define and_shared(p, v) atomic_fetch_and_explicit((p), (v), memory_order_release)
+#else
+#define SHARED(T) T
+#define load_shared(p) (*(p))
+#define store_shared(p, v) (*(p) = (v))
+#define cas_shared(p, expect, desired) \
+    (*(p) == *(expect) ? (*(p) = (desired), 1) : (*(expect) = *(p), 0))
+#define and_shared(p, v) (*(p) &= (v))
+#endif
+
+typedef uint32_t bitmap_t;  // one bit per block, set while in use
+#define BITMAP_BITS (sizeof(bitmap_t) * 8)
+#define BITMAP_ONES (~(bitmap_t)0)
+#define CTZ(x) __builtin_ctz(x)
+_Static_assert(CONTEXT_POOL_BITMAP_BYTES(1) % sizeof(bitmap_t) == 0, "pool bitmap words");
+
+#define POOL_BITMAP(pool) ((SHARED(bitmap_t)*)(pool)->in_use)
+
+#ifdef CONTEXT_STATS
+#ifdef CONTEXT_LOCKFREE
+#define stat_add(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define stat_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+static uint32_t stat_add(uint32_t *p, uint32_t v)
+{
+    uint32_t was = *p;
+    *p += v;
+    return was;
+}
+#define stat_load(p) (*(p))
+#endif
+
+/**
+ * @brief power of two bucket for a count
+ */
+static int stat_bucket(uint32_t value)
+{
+    int b = value ? 31 - __builtin_clz(value) : 0;
+    return b < CONTEXT_STATS_BUCKETS ? b : CONTEXT_STATS_BUCKETS - 1;
+}
+
+static void stat_alloc(context_pool_stats_t *stats, uint32_t blocks, uint32_t runs)
+{
+    uint32_t now = stat_add(&stats->blocks_in_use, blocks) + blocks;
+    uint32_t peak = stat_load(&stats->peak_blocks_in_use);
+    while(now > peak)
+    {
+#ifdef CONTEXT_LOCKFREE
+        if(__atomic_compare_exchange_n(&stats->peak_blocks_in_use, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+#else
+        stats->peak_blocks_in_use = peak = now;
+#endif
+    }
+    stat_add(&stats->allocations, 1);
+    stat_add(&stats->scan_cost[stat_bucket(runs)], 1);
+}
+#define STAT_ALLOC(stats, blocks, runs) stat_alloc((stats), (blocks), (runs))
+#define STAT_FAIL(stats, blocks) stat_add(&(stats)->alloc_failures[stat_bucket(blocks)], 1)
+#define STAT_FREE(stats, blocks) stat_add(&(stats)->blocks_in_use, -(uint32_t)(blocks))
+#else
+#define STAT_ALLOC(stats, blocks, runs)
+#define STAT_FAIL(stats, blocks)
+#define STAT_FREE(stats, blocks)
+#endif
+
+// pools by the id written into each block header
+typedef context_pool_t *pool_ref_t;
+static SHARED(pool_ref_t) pools[CONTEXT_MAX_POOLS];
+
+/**
+ * @brief find the first block at or after from whose in_use bit differs
+ *  from the pattern, a word at a time.
+ * 
+ * @param pool the pool to scan
+ * @param from first block index to look at
+ * @param invert 0 to find the next used block, BITMAP_ONES to find the next free one
+ * @return int block index, pool->count if there is none
+ */
+static int scan_bits(const context_pool_t *pool, int from, bitmap_t invert)
+{
+    const int count = (int)pool->count;
+    SHARED(bitmap_t) *in_use = POOL_BITMAP(pool);
+    if(from >= count)
+    {
+        return count;
+    }
+    int w = from / BITMAP_BITS;
+    const int words = (count + BITMAP_BITS - 1) / BITMAP_BITS;
+    bitmap_t bits = (load_shared(&in_use[w]) ^ invert) & (BITMAP_ONES << (from % BITMAP_BITS));
+    while(bits == 0)
+    {
+        if(++w >= words)
+        {
+            return count;
+        }
+        bits = load_shared(&in_use[w]) ^ invert;
+    }
+    int index = w * BITMAP_BITS + CTZ(bits);
+    return index < count ? index : count;  // pad bits past the end read as free
+}
+#define next_used(pool, from) scan_bits((pool), (from), 0)
+#define next_free(pool, from) scan_bits((pool), (from), BITMAP_ONES)
+
+/**
+ * @brief mask for the part of a run of blocks that lies in its first word
+ * 
+ * @param first first block of the run
+ * @param count number of blocks in the run
+ * @param n set to the number of blocks covered by the mask
+ * @return bitmap_t mask within word first / BITMAP_BITS
+ */
+static bitmap_t run_mask(int first, int count, int *n)
+{
+    int bit = first % BITMAP_BITS;
+    *n = (int)BITMAP_BITS - bit < count ? (int)BITMAP_BITS - bit : count;
+    return (*n == (int)BITMAP_BITS ? BITMAP_ONES : (((bitmap_t)1 << *n) - 1)) << bit;
+}
+
+/**
+ * @brief clear the in_use bits for a run of blocks, one mask per word
+ * 
+ * @param pool the owning pool
+ * @param first first block of the run
+ * @param count number of blocks in the run
+ */
+static void release_run(context_pool_t *pool, int first, int count)
+{
+    int n;
+    for(; count > 0; first += n, count -= n)
+    {
+        and_shared(&POOL_BITMAP(pool)[first / BITMAP_BITS], ~run_mask(first, count, &n));
+    }
+}
+
+/**
+ * @brief set the in_use bits for a run of blocks, one CAS per word.  If any
+ *  block of the run was taken meanwhile the words already claimed are
+ *  handed back.
+ * 
+ * @param pool the owning pool
+ * @param first first block of the run
+ * @param count number of blocks in the run
+ * @return int 1 if the run is now owned, 0 if it was lost
+ */
+static int claim_run(context_pool_t *pool, int first, int count)
+{
+    int n;
+    for(int done = 0; done < count; done += n)
+    {
+        SHARED(bitmap_t) *word = &POOL_BITMAP(pool)[(first + done) / BITMAP_BITS];
+        bitmap_t mask = run_mask(first + done, count - done, &n);
+        bitmap_t old = load_shared(word);
+        do
+        {
+            if(old & mask)
+            {
+                release_run(pool, first, done);
+                return 0;
+            }
+        } while(!cas_shared(word, &old, old | mask));
+    }
+    return 1;
+}
+
+/**
+ * @brief pool allocation function, allocate 1 or more
+ *  blocks depending on needed. First fit, hopping from run to run
+ *  of free blocks rather than testing each block.
+ * 
+ * @param pool pool to allocate from
+ * @param needed require size in bytes, extended to the blocks taken
+ * @return context_blk_t* 
+ */
+static context_blk_t *pool_allocate(context_pool_t *pool, size_t *needed)
+{
+    ldiv_t blks = ldiv(*needed, pool->blk_size);
+    if (blks.rem)
+    {
+        blks.quot++;
+    }
+    // extend the required to actual 
+    *needed = blks.quot * pool->blk_size;
+    if(blks.quot > (long)pool->count)
+    {
+        STAT_FAIL(&pool->stats, blks.quot);
+        return NULL; // can never fit
+    }
+    const int count = (int)pool->count;
+    uint32_t runs = 0;
+    for(int i=next_free(pool, 0); i<count; i=next_free(pool, i))  // each run of free blocks
+    {
+        int end = next_used(pool, i);
+        runs++;
+        if(end - i >= blks.quot)  // required was available
+        {
+            if(claim_run(pool, i, blks.quot))
+            {
+                STAT_ALLOC(&pool->stats, blks.quot, runs);
+                return (context_blk_t*)&pool->blocks[(size_t)i * pool->blk_size];
+            }
+            continue;   // raced with another context, look at this run again
+        }
+        i = end;    // blocked by allocated block, skip past it
+    }
+    STAT_FAIL(&pool->stats, blks.quot);
+    (void)runs;
+    return NULL; // could not allocate
+}
+
+/**
+ * @brief index of a block in its pool, -1 if blk is not the start of a 
+ *  block of this pool
+ */
+static ptrdiff_t pool_index(const context_pool_t *pool, const context_blk_t *blk)
+{
+    ptrdiff_t offset = (const uint8_t*)blk - pool->blocks;  // pointer math
+    if(offset < 0 || offset >= (ptrdiff_t)(pool->count * pool->blk_size) || offset % (ptrdiff_t)pool->blk_size)
+    {
+        return -1;
+    }
+    return offset / (ptrdiff_t)pool->blk_size;
+}
+
+/**
+ * @brief take pointer to a blk and free its associated space if valid
+ * 
+ * @param pool the owning pool
+ * @param blk pointer to blk
+ */
+static void pool_free(context_pool_t *pool, context_blk_t *blk)
+{
+    // validate the pointer
+    ptrdiff_t index = pool_index(pool, blk);
+    // if pointer is valid, clear the in_use bits
+    if(index >= 0)
+    {
+        release_run(pool, index, blk->size/pool->blk_size);
+        STAT_FREE(&pool->stats, blk->size/pool->blk_size);
+    }
+    else // nothing we can do, just throw an assert
+    {
+        // run time error will lose memory block
+        assert(index >= 0);
+    }
+}
+
+/**
+ * @brief point a pool object at its memory, the bitmap is left as it is
+ */
+static void pool_layout(context_pool_t *pool, void *memory, size_t blk_size, size_t count)
+{
+    assert(blk_size % sizeof(uint64_t) == 0 && blk_size > sizeof(context_blk_t));
+    assert(((uintptr_t)memory % sizeof(uint64_t)) == 0);
+    pool->in_use = memory;
+    pool->blocks = (uint8_t*)memory + CONTEXT_POOL_BITMAP_BYTES(count);
+    pool->blk_size = blk_size;
+    pool->count = count;
+#ifdef CONTEXT_STATS
+    memset(&pool->stats, 0, sizeof pool->stats);
+#endif
+}
+
+/**
+ * @brief register a pool under an id, if the id is free
+ */
+static int pool_register(context_pool_t *pool, uint16_t id)
+{
+    pool_ref_t none = NULL;
+    if(cas_shared(&pools[id], &none, pool))
+    {
+        pool->id = id;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief register a pool under the first free id, 0 is the default pool
+ */
+static int pool_register_any(context_pool_t *pool)
+{
+    for(uint16_t id=1; id<CONTEXT_MAX_POOLS; id++)
+    {
+        if(pool_register(pool, id))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int context_pool_init(context_pool_t *pool, void *memory, size_t blk_size, size_t count)
+{
+    pool_layout(pool, memory, blk_size, count);
+    memset(memory, 0, CONTEXT_POOL_BITMAP_BYTES(count));
+    return pool_register_any(pool);
+}
+
+int context_pool_attach(context_pool_t *pool, void *memory, size_t blk_size, size_t count, uint16_t id)
+{
+    assert(id > 0 && id < CONTEXT_MAX_POOLS);
+    pool_layout(pool, memory, blk_size, count);
+    return id > 0 && id < CONTEXT_MAX_POOLS && pool_register(pool, id);
+}
+
+size_t context_pool_offset(const context_pool_t *pool, const context_blk_t *blk)
+{
+    // run time error, not a closure of this pool
+    assert(pool_index(pool, blk) >= 0);
+    return (size_t)((const uint8_t*)blk - pool->blocks);
+}
+
+context_blk_t *context_pool_at(const context_pool_t *pool, size_t offset)
+{
+    if(offset >= pool->count * pool->blk_size || offset % pool->blk_size)
+    {
+        return NULL;
+    }
+    return (context_blk_t*)&pool->blocks[offset];
+}
+
+void context_pool_deinit(context_pool_t *pool)
+{
+    assert(pool->id > 0 && pool->id < CONTEXT_MAX_POOLS && load_shared(&pools[pool->id]) == pool);
+    store_shared(&pools[pool->id], NULL);
+}
+
 #ifndef USE_MALLOC  // a buffer allocation pool if not using malloc
 
-#define BLKS 64  // allocate 64 possible blocks (16k)
-typedef uint64_t space_blk_t[32];   
-#define BLK_SIZE (sizeof(space_blk_t))
+#ifndef BLKS
+#define BLKS 64  // allocate 64 possible blocks (16k)
+#endif
+typedef uint64_t space_blk_t[CONTEXT_BLK_SIZE / sizeof(uint64_t)];
+_Static_assert(CONTEXT_BLK_SIZE % sizeof(uint64_t) == 0, "CONTEXT_BLK_SIZE must be a multiple of 8");
+#define BLK_SIZE (sizeof(space_blk_t))
+#define BITMAP_WORDS ((BLKS + BITMAP_BITS - 1) / BITMAP_BITS)
+
+static _Alignas(CONTEXT_CACHE_LINE) space_blk_t space[BLKS];  // closures start on their own line if blocks are whole lines
+static SHARED(bitmap_t) in_use[BITMAP_WORDS];
+static context_pool_t default_pool = {.blocks = (uint8_t*)space, .in_use = (void*)in_use,
+                                      .blk_size = BLK_SIZE, .count = BLKS, .id = CONTEXT_POOL_DEFAULT};
+
+#ifdef USE_BUDDY
+/*
+    Buddy mode: space[] is split into power of two runs of blocks.  A request
+    is rounded up to a power of two, so at most half of a run is ever wasted,
+    taken from the smallest order that has a free run and split down, the
+    upper halves going back on the lists.  free_context_blk() merges a run
+    with its buddy for as long as the buddy is free and whole.  Both walk at
+    most log2(BLKS) orders, so allocate and free take bounded time however
+    fragmented the pool is.  The free lists are linked through the first
+    bytes of each free run.
+*/
+#if defined(CONTEXT_SIZE_CLASSES) || defined(CONTEXT_LOCKFREE)
+#error "USE_BUDDY keeps plain free lists, it does not combine with CONTEXT_SIZE_CLASSES or CONTEXT_LOCKFREE"
+#endif
+_Static_assert((BLKS & (BLKS - 1)) == 0, "USE_BUDDY needs BLKS to be a power of 2");
+_Static_assert(BLKS < 0x10000, "buddy links are 16 bit block indexes");
+
+#define BUDDY_TOP CTZ(BLKS)        // order of the whole of space[]
+#define BUDDY_NONE 0xFFFFu         // ends a free list
+
+typedef struct buddy_link_t
+{
+    uint16_t next;
+    uint16_t prev;
+} buddy_link_t;
+
+static uint16_t buddy_head[16];         // first free run of each order
+static uint32_t buddy_nonempty;         // bit per order with a free run
+static uint8_t buddy_free[BLKS];        // order + 1 at the start of a free run
+static int buddy_ready;
+
+// the links live in the free runs themselves, copied in and out so they
+// do not alias the uint64_t blocks
+static buddy_link_t buddy_link(unsigned index)
+{
+    buddy_link_t link;
+    memcpy(&link, space[index], sizeof link);
+    return link;
+}
+
+static void buddy_set_link(unsigned index, buddy_link_t link)
+{
+    memcpy(space[index], &link, sizeof link);
+}
+
+static void buddy_push(unsigned index, unsigned order)
+{
+    buddy_set_link(index, (buddy_link_t){.next=buddy_head[order], .prev=BUDDY_NONE});
+    if(buddy_head[order] != BUDDY_NONE)
+    {
+        buddy_link_t head = buddy_link(buddy_head[order]);
+        head.prev = (uint16_t)index;
+        buddy_set_link(buddy_head[order], head);
+    }
+    buddy_head[order] = (uint16_t)index;
+    buddy_free[index] = (uint8_t)(order + 1);
+    buddy_nonempty |= 1u << order;
+}
+
+static void buddy_remove(unsigned index, unsigned order)
+{
+    buddy_link_t link = buddy_link(index);
+    if(link.prev != BUDDY_NONE)
+    {
+        buddy_link_t prev = buddy_link(link.prev);
+        prev.next = link.next;
+        buddy_set_link(link.prev, prev);
+    }
+    else
+    {
+        buddy_head[order] = link.next;
+    }
+    if(link.next != BUDDY_NONE)
+    {
+        buddy_link_t next = buddy_link(link.next);
+        next.prev = link.prev;
+        buddy_set_link(link.next, next);
+    }
+    if(buddy_head[order] == BUDDY_NONE)
+    {
+        buddy_nonempty &= ~(1u << order);
+    }
+    buddy_free[index] = 0;
+}
+
+static void buddy_init(void)
+{
+    memset(buddy_head, 0xFF, sizeof buddy_head);
+    buddy_push(0, BUDDY_TOP);  // all of space[] as one run
+    buddy_ready = 1;
+}
+
+/**
+ * @brief take the smallest power of two run of blocks that fits
+ * 
+ * @param needed require size in bytes, extended to what was allocated
+ * @return context_blk_t* 
+ */
+static context_blk_t *allocate_space(size_t *needed)
+{
+    if(!buddy_ready)
+    {
+        buddy_init();
+    }
+    size_t blocks = (*needed + BLK_SIZE - 1) / BLK_SIZE;
+    unsigned order = blocks > 1 ? 32 - __builtin_clz((unsigned)(blocks - 1)) : 0;
+    uint32_t fits = order <= BUDDY_TOP ? buddy_nonempty >> order : 0;  // orders large enough
+    if(!fits)
+    {
+        STAT_FAIL(&default_pool.stats, blocks);
+        return NULL;
+    }
+    unsigned k = order + CTZ(fits);
+    unsigned index = buddy_head[k];
+    buddy_remove(index, k);
+    while(k > order)  // split, the upper half stays free
+    {
+        k--;
+        buddy_push(index + (1u << k), k);
+    }
+    *needed = ((size_t)1 << order) * BLK_SIZE;
+    STAT_ALLOC(&default_pool.stats, 1u << order, 1);
+    return (context_blk_t*)space[index];
+}
+
+static void free_space(context_blk_t *blk)
+{
+    ptrdiff_t found = pool_index(&default_pool, blk);
+    // run time error will lose memory block
+    assert(found >= 0);
+    if(found < 0)
+    {
+        return;
+    }
+    unsigned index = (unsigned)found;
+    unsigned order = CTZ(blk->size / BLK_SIZE);
+    STAT_FREE(&default_pool.stats, blk->size / BLK_SIZE);
+    while(order < BUDDY_TOP)  // merge while the buddy is free and whole
+    {
+        unsigned buddy = index ^ (1u << order);
+        if(buddy_free[buddy] != order + 1)
+        {
+            break;
+        }
+        buddy_remove(buddy, order);
+        index &= ~(1u << order);
+        order++;
+    }
+    buddy_push(index, order);
+}
+
+void free_context_batch(context_blk_t **blks, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+    {
+        free_context_blk(blks[i]);
+    }
+}
+#else  // first fit
+
+#if defined(CONTEXT_THREAD_CACHE) && !(defined(CONTEXT_SIZE_CLASSES) && defined(CONTEXT_LOCKFREE))
+#error "CONTEXT_THREAD_CACHE caches size class slots of a shared pool, define CONTEXT_SIZE_CLASSES and CONTEXT_LOCKFREE too"
+#endif
+
+#ifdef CONTEXT_SIZE_CLASSES
+/*
+    Size-class mode: each class is a fixed number of slots of a fixed number
+    of space_blk_t, kept on its own intrusive free list so the common closure
+    sizes never fragment the first-fit space[].  Requests that no class can
+    take fall through to space[].  List classes smallest first as
+    X(blocks per slot, slot count).  The free lists are Treiber stacks linked
+    by slot index, with an ABA tag beside the head index so a slot that is
+    popped and pushed back between a load and a CAS is noticed.
+*/
+#ifndef SIZE_CLASSES
+#define SIZE_CLASSES(X) X(1, 16) X(2, 8) X(4, 4)  // 256B, 512B and 1KiB slots
+#endif
+
+#define CLASS_COUNT_OF(units, slots) + 1
+#define CLASS_SPACE_OF(units, slots) + (units) * (slots)
+#define CLASS_COUNT (0 SIZE_CLASSES(CLASS_COUNT_OF))
+#define CLASS_SPACE (0 SIZE_CLASSES(CLASS_SPACE_OF))
+
+#define LINK_MASK 0xFFFFu     // slot index + 1, zero ends a list
+#define TAG_STEP 0x10000u     // ABA tag in the upper half of a list head
+
+typedef struct free_slot_t
+{
+    SHARED(uint32_t) next;  // link to the next free slot
+} free_slot_t;
+
+typedef struct size_class_t
+{
+    const uint16_t units;   // space_blk_t per slot
+    const uint16_t slots;   // number of slots in the class
+    SHARED(uint16_t) unused;     // slots never handed out, taken from the top
+    SHARED(uint32_t) free_list;  // tag and link of slots handed out and returned
+} size_class_t;
+
+static _Alignas(CONTEXT_CACHE_LINE) space_blk_t class_space[CLASS_SPACE];
+
+#define CLASS_ENTRY(u, n) {.units = (u), .slots = (n)},
+static size_class_t classes[CLASS_COUNT] = {SIZE_CLASSES(CLASS_ENTRY)};
+
+#define SLOT_AT(sc, base, link) ((free_slot_t*)&(base)[(size_t)((link) - 1) * (sc)->units])
+#define LINK_OF(sc, base, slot) ((uint32_t)(((space_blk_t*)(slot) - (base)) / (sc)->units) + 1)
+
+#ifndef CONTEXT_THREAD_CACHE  // the magazines take chains instead
+/**
+ * @brief take one slot of a class from its shared free list, or a never
+ *  used one if the list is empty
+ * 
+ * @param sc the class
+ * @param base first slot of the class in class_space
+ * @return free_slot_t* NULL if the class is exhausted
+ */
+static free_slot_t *class_pop(size_class_t *sc, space_blk_t *base)
+{
+    uint32_t head = load_shared(&sc->free_list);
+    while(head & LINK_MASK)
+    {
+        free_slot_t *slot = SLOT_AT(sc, base, head & LINK_MASK);
+        uint32_t next = ((head & ~LINK_MASK) + TAG_STEP) | load_shared(&slot->next);
+        if(cas_shared(&sc->free_list, &head, next))
+        {
+            return slot;
+        }
+        // lost the race, head was reloaded
+    }
+    uint16_t unused = load_shared(&sc->unused);
+    while(unused < sc->slots && !cas_shared(&sc->unused, &unused, unused + 1))
+    {
+    }
+    return unused < sc->slots ? SLOT_AT(sc, base, unused + 1) : NULL;
+}
+#endif
+
+/**
+ * @brief return a chain of slots, already linked first to last, to the
+ *  shared free list of their class in one CAS
+ * 
+ * @param sc the class
+ * @param base first slot of the class in class_space
+ * @param first head of the chain
+ * @param last tail of the chain, its link is overwritten
+ */
+static void class_push(size_class_t *sc, space_blk_t *base, free_slot_t *first, free_slot_t *last)
+{
+    uint32_t link = LINK_OF(sc, base, first);
+    uint32_t head = load_shared(&sc->free_list);
+    do
+    {
+        store_shared(&last->next, head & LINK_MASK);
+    } while(!cas_shared(&sc->free_list, &head, ((head & ~LINK_MASK) + TAG_STEP) | link));
+}
+
+#ifdef CONTEXT_THREAD_CACHE
+/*
+    Thread cache mode: each thread keeps a small magazine of slots per class
+    and allocates and frees against it without touching the shared lists.
+    An empty magazine refills half way by detaching a chain from the shared
+    list, and a full one flushes half of itself back as one linked chain,
+    each with a single CAS.  A slot goes to the cache of whichever thread frees it, as in tcmalloc.
+    Thread locals are not interrupt safe, so this is for hosted builds only.
+*/
+#ifndef TCACHE_DEPTH
+#define TCACHE_DEPTH 8  // slots cached per class per thread
+#endif
+
+typedef struct magazine_t
+{
+    uint16_t count;
+    free_slot_t *slots[TCACHE_DEPTH];
+} magazine_t;
+
+static _Thread_local magazine_t magazines[CLASS_COUNT];
+
+/**
+ * @brief return half of a magazine, the oldest slots, to the shared list
+ */
+static void magazine_flush(size_class_t *sc, space_blk_t *base, magazine_t *mag, uint16_t keep)
+{
+    if(mag->count <= keep)
+    {
+        return;
+    }
+    uint16_t give = mag->count - keep;
+    for(uint16_t i=0; i+1<give; i++)  // chain slots[0..give) together
+    {
+        store_shared(&mag->slots[i]->next, LINK_OF(sc, base, mag->slots[i+1]));
+    }
+    class_push(sc, base, mag->slots[0], mag->slots[give-1]);
+    memmove(mag->slots, &mag->slots[give], keep * sizeof mag->slots[0]);
+    mag->count = keep;
+}
+
+/**
+ * @brief take up to max slots of a class in one CAS, a chain detached from
+ *  the shared free list or else a run of never used ones.  The ABA tag is
+ *  what makes the walk safe: if any slot was popped or pushed meanwhile the
+ *  head changed and the CAS fails.
+ *
+ * @param sc the class
+ * @param base first slot of the class in class_space
+ * @param out the slots taken
+ * @param max most slots to take
+ * @return uint16_t slots taken, 0 if the class is exhausted
+ */
+static uint16_t class_pop_chain(size_class_t *sc, space_blk_t *base, free_slot_t **out, uint16_t max)
+{
+    uint32_t head = load_shared(&sc->free_list);
+    while(head & LINK_MASK)
+    {
+        uint16_t n = 0;
+        uint32_t link = head & LINK_MASK;
+        while(link && n < max)
+        {
+            out[n] = SLOT_AT(sc, base, link);
+            link = load_shared(&out[n++]->next);
+            if(link > sc->slots)
+            {
+                break;  // read from a slot taken meanwhile, the CAS would fail
+            }
+        }
+        if(link > sc->slots)
+        {
+            head = load_shared(&sc->free_list);
+        }
+        else if(cas_shared(&sc->free_list, &head, ((head & ~LINK_MASK) + TAG_STEP) | link))
+        {
+            return n;
+        }
+        // lost the race, head was reloaded
+    }
+    uint16_t unused = load_shared(&sc->unused);
+    uint16_t n;
+    do
+    {
+        n = sc->slots - unused < max ? (uint16_t)(sc->slots - unused) : max;
+    } while(n && !cas_shared(&sc->unused, &unused, unused + n));
+    for(uint16_t i=0; i<n; i++)
+    {
+        out[i] = SLOT_AT(sc, base, unused + 1 + i);
+    }
+    return n;
+}
+
+void context_thread_cache_flush(void)
+{
+    space_blk_t *base = class_space;
+    for(int c=0; c<CLASS_COUNT; base += (size_t)classes[c].units * classes[c].slots, c++)
+    {
+        magazine_flush(&classes[c], base, &magazines[c], 0);
+    }
+}
+#endif
+
+/**
+ * @brief pop a slot from the smallest class that fits and has one free
+ * 
+ * @param units space_blk_t required
+ * @param needed set to the slot size in bytes on success
+ * @return context_blk_t* NULL if no class can take the request
+ */
+static context_blk_t *class_allocate(long units, size_t *needed)
+{
+    space_blk_t *base = class_space;  // classes are laid out in order
+    for(int c=0; c<CLASS_COUNT; base += (size_t)classes[c].units * classes[c].slots, c++)
+    {
+        size_class_t *sc = &classes[c];
+        if(sc->units < units)
+        {
+            continue;
+        }
+#ifdef CONTEXT_THREAD_CACHE
+        magazine_t *mag = &magazines[c];
+        if(mag->count == 0)
+        {
+            mag->count = class_pop_chain(sc, base, mag->slots, TCACHE_DEPTH / 2);
+        }
+        free_slot_t *slot = mag->count ? mag->slots[--mag->count] : NULL;
+#else
+        free_slot_t *slot = class_pop(sc, base);
+#endif
+        if(slot)
+        {
+            *needed = sc->units * sizeof(space_blk_t);
+            return (context_blk_t*)slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief push a block back on its class free list
+ * 
+ * @param blk pointer to blk
+ * @return int 1 if the block belonged to a class, 0 if it is from space[]
+ */
+static int class_free(context_blk_t *blk)
+{
+    space_blk_t *p = (space_blk_t*)blk;
+    if(p < class_space || p >= &class_space[CLASS_SPACE])
+    {
+        return 0;
+    }
+    space_blk_t *base = class_space;
+    for(int c=0; c<CLASS_COUNT; base += (size_t)classes[c].units * classes[c].slots, c++)
+    {
+        size_class_t *sc = &classes[c];
+        if(p < base + (size_t)sc->units * sc->slots)
+        {
+            // validate pointer alignment, run time error will lose the slot
+            assert((p - base) % sc->units == 0);
+#ifdef CONTEXT_THREAD_CACHE
+            magazine_t *mag = &magazines[c];
+            if(mag->count == TCACHE_DEPTH)
+            {
+                magazine_flush(sc, base, mag, TCACHE_DEPTH / 2);
+            }
+            mag->slots[mag->count++] = (free_slot_t*)blk;
+#else
+            class_push(sc, base, (free_slot_t*)blk, (free_slot_t*)blk);
+#endif
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/**
+ * @brief default allocation, size classes first if enabled, then first fit
+ *  over space[]
+ * 
+ * @param needed require size in bytes, extended to what was allocated
+ * @return context_blk_t* 
+ */
+static context_blk_t *allocate_space(size_t *needed)
+{
+#ifdef CONTEXT_SIZE_CLASSES
+    context_blk_t *slot = class_allocate((long)((*needed + BLK_SIZE - 1) / BLK_SIZE), needed);
+    if(slot)
+    {
+        STAT_ALLOC(&default_pool.stats, *needed / BLK_SIZE, 0);
+        return slot;
+    }
+#endif
+    return pool_allocate(&default_pool, needed);
+}
+
+static void free_space(context_blk_t *blk)
+{
+#ifdef CONTEXT_SIZE_CLASSES
+    if(class_free(blk))
+    {
+        STAT_FREE(&default_pool.stats, blk->size / BLK_SIZE);
+        return;
+    }
+#endif
+    pool_free(&default_pool, blk);
+}
+
+void free_context_batch(context_blk_t **blks, size_t n)
+{
+    bitmap_t release[BITMAP_WORDS] = {0};
+    int n_bits;
+    for(size_t i=0; i<n; i++)
+    {
+        context_blk_t *blk = blks[i];
+        ptrdiff_t index = pool_index(&default_pool, blk);
+        if(blk->pool != CONTEXT_POOL_DEFAULT || index < 0)
+        {
+            free_context_blk(blk);  // not a space[] run, free it on its own
+            continue;
+        }
+        for(int first = index, count = blk->size/BLK_SIZE; count > 0; first += n_bits, count -= n_bits)
+        {
+            release[first / BITMAP_BITS] |= run_mask(first, count, &n_bits);
+        }
+        STAT_FREE(&default_pool.stats, blk->size/BLK_SIZE);
+    }
+    for(size_t w=0; w<BITMAP_WORDS; w++)
+    {
+        if(release[w])
+        {
+            and_shared(&in_use[w], ~release[w]);
+        }
+    }
+}
+
+#endif // USE_BUDDY
+
+#ifdef CONTEXT_GROW
+/*
+    Segments are pools laid over memory from the segment heap.  A segment
+    is only searched while its bit is set in seg_live.  Growing fills in
+    the blocks pointer before it opens the bitmap, and trimming first claims
+    every block, so a context still looking at a segment that goes away
+    finds it full.  Growing and trimming take seg_busy, one at a time.
+*/
+#if CONTEXT_SEGMENTS > 32 || CONTEXT_SEGMENTS >= CONTEXT_MAX_POOLS
+#error "CONTEXT_SEGMENTS must be at most 32 and leave room in CONTEXT_MAX_POOLS"
+#endif
+#define SEG_BYTES ((size_t)CONTEXT_SEGMENT_BLKS * BLK_SIZE)
+_Static_assert(SEG_BYTES % CONTEXT_CACHE_LINE == 0, "segments are whole cache lines");
+
+static context_pool_t segments[CONTEXT_SEGMENTS];
+static SHARED(bitmap_t) seg_bitmap[CONTEXT_SEGMENTS][CONTEXT_POOL_BITMAP_BYTES(CONTEXT_SEGMENT_BLKS) / sizeof(bitmap_t)];
+static SHARED(uint32_t) seg_live;   // bit per segment holding memory
+static SHARED(int) seg_busy;        // a grow or trim is under way
+static SHARED(int) seg_hint;        // segment that last had room
+
+static void *segment_alloc(size_t size)
+{
+    return aligned_alloc(CONTEXT_CACHE_LINE, size);
+}
+
+static void segment_free(void *ptr, size_t size)
+{
+    (void)size;
+    free(ptr);
+}
+
+static ctx_alloc_t seg_alloc = segment_alloc;
+static ctx_free_t seg_free = segment_free;
+
+void context_set_segment_heap(ctx_alloc_t alloc, ctx_free_t release)
+{
+    seg_alloc = alloc ? alloc : segment_alloc;
+    seg_free = release ? release : segment_free;
+}
+
+/**
+ * @brief add a segment, if there is a free slot and no one else is growing
+ * 
+ * @return int 1 if a segment was added
+ */
+static int segment_grow(void)
+{
+    int idle = 0;
+    if(!cas_shared(&seg_busy, &idle, 1))
+    {
+        return 0;
+    }
+    int grown = 0;
+    uint32_t live = load_shared(&seg_live);
+    uint32_t unused = ~live & (uint32_t)((1ull << CONTEXT_SEGMENTS) - 1);
+    if(unused)
+    {
+        int i = CTZ(unused);
+        context_pool_t *seg = &segments[i];
+        void *memory = seg_alloc(SEG_BYTES);
+        if(memory && (seg->in_use || pool_register_any(seg)))  // a slot keeps its id once it has one
+        {
+            seg->in_use = seg_bitmap[i];
+            seg->blk_size = BLK_SIZE;
+            seg->count = CONTEXT_SEGMENT_BLKS;
+            seg->blocks = memory;
+            release_run(seg, 0, CONTEXT_SEGMENT_BLKS);  // open for allocation, a trim left it claimed
+            store_shared(&seg_hint, i);
+            store_shared(&seg_live, live | (1u << i));
+            grown = 1;
+        }
+        else if(memory)
+        {
+            seg_free(memory, SEG_BYTES);
+        }
+    }
+    store_shared(&seg_busy, 0);
+    return grown;
+}
+
+/**
+ * @brief allocate from the segments once the built in pool is full, growing
+ *  by one segment if none has room
+ * 
+ * @param needed require size in bytes, extended to the blocks taken
+ * @param from set to the segment allocated from
+ * @return context_blk_t* NULL if no segment has room and none could be added
+ */
+static context_blk_t *segment_allocate(size_t *needed, context_pool_t **from)
+{
+    for(int attempt=0; attempt<2; attempt++)
+    {
+        uint32_t live = load_shared(&seg_live);
+        int hint = load_shared(&seg_hint);
+        for(int k=0; k<CONTEXT_SEGMENTS; k++)  // the last to have room first
+        {
+            int i = (hint + k) % CONTEXT_SEGMENTS;
+            context_blk_t *blk = (live & (1u << i)) ? pool_allocate(&segments[i], needed) : NULL;
+            if(blk)
+            {
+                if(i != hint)
+                {
+                    store_shared(&seg_hint, i);
+                }
+                *from = &segments[i];
+                return blk;
+            }
+        }
+        if(*needed > SEG_BYTES || !segment_grow())
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+size_t context_pool_trim(void)
+{
+    int idle = 0;
+    if(!cas_shared(&seg_busy, &idle, 1))
+    {
+        return 0;
+    }
+    size_t released = 0;
+    uint32_t live = load_shared(&seg_live);
+    for(int i=0; i<CONTEXT_SEGMENTS; i++)
+    {
+        // claiming every block proves the segment idle and keeps it that way
+        if((live & (1u << i)) && claim_run(&segments[i], 0, CONTEXT_SEGMENT_BLKS))
+        {
+            live &= ~(1u << i);
+            store_shared(&seg_live, live);
+            seg_free(segments[i].blocks, SEG_BYTES);
+            released++;
+        }
+    }
+    store_shared(&seg_busy, 0);
+    return released;
+}
+#endif // CONTEXT_GROW
+
+#else  // we are using malloc
+#ifdef USE_BUDDY
+#error "USE_BUDDY and USE_MALLOC are alternative allocators, define one"
+#endif
+#ifdef CONTEXT_GROW
+#error "CONTEXT_GROW adds segments to the static pool, a USE_MALLOC heap grows by itself"
+#endif
+#ifdef CONTEXT_STATS
+static context_pool_stats_t heap_stats;
+#endif
+
+static void *heap_alloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void heap_free(void *ptr, size_t size)
+{
+    (void)size;
+    free(ptr);
+}
+
+static ctx_alloc_t ctx_alloc = heap_alloc;
+static ctx_free_t ctx_free = heap_free;
+
+void context_set_heap(ctx_alloc_t alloc, ctx_free_t release)
+{
+    ctx_alloc = alloc ? alloc : heap_alloc;
+    ctx_free = release ? release : heap_free;
+}
+
+static context_blk_t *allocate_space(size_t *needed)
+{
+    // the heap hands out whole granules, the rest of the last is workspace
+    *needed = (*needed + CONTEXT_HEAP_ALIGN - 1) & ~(size_t)(CONTEXT_HEAP_ALIGN - 1);
+    context_blk_t *blk = ctx_alloc(*needed);
+    if(blk)
+    {
+        STAT_ALLOC(&heap_stats, 1, 0);
+    }
+    else
+    {
+        STAT_FAIL(&heap_stats, 1);
+    }
+    return blk;  // make sure to test for NULL
+}
+
+static void free_space(context_blk_t *blk)
+{
+    STAT_FREE(&heap_stats, 1);
+    ctx_free(blk, blk->size);  // the size lets a sized heap skip its lookup
+}
 
-static space_blk_t space[BLKS];
-static uint8_t in_use[BLKS];
+void free_context_batch(context_blk_t **blks, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+    {
+        free_context_blk(blks[i]);
+    }
+}
+#endif
 
 /**
- * @brief static allocation function, allocate 1 or more
- *  blocks depending on needed.
+ * @brief take pointer to a blk and free it back to the pool named in its 
+ *  header
  * 
- * @param needed require size in bytes
- * @return context_blk_t* 
+ * @param blk pointer to blk
  */
-static context_blk_t *allocate_space(size_t *needed)
+void free_context_blk(context_blk_t *blk)
 {
-    ldiv_t blks = ldiv(*needed, sizeof(space_blk_t));
-    if (blks.rem)
+    if(blk->pool == CONTEXT_POOL_DEFAULT)
     {
-        blks.quot++;
+        free_space(blk);
+        return;
     }
-    // extend the required to actual 
-    *needed = blks.quot * sizeof(space_blk_t) ;
-    for(int i=0; i<BLKS; i++)  // scan all available blocks
+    if(blk->pool == CONTEXT_POOL_NONE)
     {
-        if(in_use[i] == 0) // if available
-        {
-            in_use[i] = 2;  // claim the first
-            for(int j=i+1; j<BLKS; j++)
-            {
-                if(j == i+blks.quot)  // required was available
-                {
-                    memset(&in_use[i], 1, blks.quot);   // consolidate ownership
-                    return (context_blk_t*)&space[i];
-                }
+        return;     // inline or arena, its memory belongs to someone else
+    }
+    context_pool_t *pool = blk->pool < CONTEXT_MAX_POOLS ? load_shared(&pools[blk->pool]) : NULL;
+    // run time error will lose memory block
+    assert(pool != NULL);
+    if(pool)
+    {
+        pool_free(pool, blk);
+    }
+}
 
-                if(in_use[j]) // blocked by allocated block
-                {
-                    memset(&in_use[i], 0, j-i); // return temp claimed
-                    i=j;    // start over
-                    break;
-                }
-                in_use[j] = 2; // else do temp claim
-            }
+#ifdef CONTEXT_STATS
+void context_pool_stats(const context_pool_t *pool, context_pool_stats_t *out)
+{
+#ifndef USE_MALLOC
+    pool = pool ? pool : &default_pool;
+#else
+    if(!pool)
+    {
+        memcpy(out, &heap_stats, sizeof *out);
+        out->largest_free_run = 0;
+        return;
+    }
+#endif
+    memcpy(out, &pool->stats, sizeof *out);
+    out->largest_free_run = 0;
+#ifdef USE_BUDDY
+    if(pool == &default_pool)
+    {
+        out->largest_free_run = buddy_ready ? (buddy_nonempty ? 1u << (31 - __builtin_clz(buddy_nonempty)) : 0) : BLKS;
+        return;
+    }
+#endif
+    const int count = (int)pool->count;
+    for(int i=next_free(pool, 0); i<count; i=next_free(pool, i))  // each run of free blocks
+    {
+        int end = next_used(pool, i);
+        if((uint32_t)(end - i) > out->largest_free_run)
+        {
+            out->largest_free_run = (uint32_t)(end - i);
         }
+        i = end;
     }
-    return NULL; // could not allocate
 }
+#endif
 
 /**
- * @brief take pointer to a blk and free its associated space if valid
+ * @brief clear the workspace of a closure as the flags ask
  * 
- * @param blk pointer to blk
+ * @param blk pointer to the closure
+ * @param flags one of the CTX_WS_ options
  */
-void free_context_blk(context_blk_t *blk)
+static void clear_workspace(context_blk_t *blk, unsigned flags)
 {
-    // validate the pointer
-    ptrdiff_t index = (space_blk_t*)blk - space;  // pointer math
-    assert(index >= 0);
-    // if pointer is valid, clear the in_use bits
-    if(&space[index] == (space_blk_t*)blk) // validate pointer alignment 
+    switch(flags & CTX_WS_MASK)
     {
-        memset(&in_use[index], 0, blk->size/sizeof(space_blk_t));
+        case CTX_WS_UNINIT:
+            break;
+        case CTX_WS_ZERO_REQUESTED_ONLY:
+            memset(context_workspace(blk), 0, blk->workspace_request);
+            break;
+        default:
+            memset(context_workspace(blk), 0, blk->workspace_size);
+            break;
     }
-    else // nothing we can do, just throw an assert
+}
+
+/**
+ * @brief fill in the header and parameters of a freshly allocated closure
+ * 
+ * @param pool_id id the closure is freed to
+ * @param ws_offset start of the workspace in user_context, uc_size or more
+ * @param total bytes allocated for it
+ * @param requested workspace bytes the caller asked for
+ */
+static context_blk_t *fill(context_blk_t *blk, uint16_t pool_id, context_func_t func, void const *user_context, size_t uc_size, size_t ws_offset, size_t total, size_t requested, unsigned flags)
+{
+    memcpy(blk, 
+        &(context_blk_t){.target_func=func, 
+                         .size=total, 
+                         .workspace_size=total - (sizeof(context_blk_t) + ws_offset),
+                         .workspace_request=requested,
+                         .pool=pool_id,
+                         .uc_size=uc_size,
+#ifdef CONTEXT_REFCOUNT
+                         .refs=1,
+#endif
+#ifdef CONTEXT_PRIORITY
+                         .priority=(flags & CTX_PRIO_MASK) >> CTX_PRIO_SHIFT,
+#endif
+#ifndef CONTEXT_NO_ORIGINAL
+                         .original_context=user_context,
+#endif
+#ifndef CONTEXT_COMPACT_HEADER
+                         .workspace=&((uint8_t*)blk->user_context)[ws_offset]},
+#else
+                         .workspace_offset=ws_offset},
+#endif
+        sizeof(context_blk_t));
+    if(user_context)
     {
-        // run time error will lose memory block
-        assert(&space[index] == (space_blk_t*)blk);
+        memcpy(blk->user_context, user_context, uc_size);
     }
+    clear_workspace(blk, flags);
+    return blk;
 }
 
-#else  // we are using malloc
-static context_blk_t *allocate_space(size_t *needed)
+// most workspace the header field holds, and that keeps the block size from wrapping a 32 bit size_t
+#ifndef CONTEXT_COMPACT_HEADER
+#define WS_LIMIT (SIZE_MAX - sizeof(context_blk_t) - 2 * UINT16_MAX < UINT32_MAX ? \
+                  SIZE_MAX - sizeof(context_blk_t) - 2 * UINT16_MAX : UINT32_MAX)
+#else
+#define WS_LIMIT UINT16_MAX
+#endif
+// do the sizes fit the header fields, padding is the worst case before an aligned workspace;
+// compared by subtracting so a size near SIZE_MAX cannot wrap past the check
+#define HEADER_FITS(uc_size, padding, workspace_size) \
+    ((padding) <= UINT16_MAX && (uc_size) <= UINT16_MAX - (padding) && (workspace_size) <= WS_LIMIT)
+
+/**
+ * @brief allocate from a pool, or from the built in pool and then its 
+ *  segments
+ * 
+ * @param pool pool to allocate from, NULL for the default, set to the 
+ *  segment used if one was
+ * @param needed require size in bytes, extended to what was allocated
+ */
+static context_blk_t *allocate_from(context_pool_t **pool, size_t *needed)
 {
-    context_blk_t *blk = malloc(*needed);
-    return blk;  // make sure to test for NULL
+    if(*pool)
+    {
+        return pool_allocate(*pool, needed);
+    }
+    context_blk_t *blk = allocate_space(needed);
+#ifdef CONTEXT_GROW
+    if(!blk)
+    {
+        blk = segment_allocate(needed, pool);
+    }
+#endif
+    return blk;
+}
+
+/**
+ * @brief allocate and fill in a closure
+ * 
+ * @param pool pool to allocate from, NULL for the default
+ * @param ws_align boundary for the workspace, a power of 2, 1 for none
+ */
+static context_blk_t *package(context_pool_t *pool, context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size, size_t ws_align, unsigned flags)
+{
+    assert(ws_align && (ws_align & (ws_align - 1)) == 0);
+    // room for the worst case padding, what the block start leaves unused stays workspace
+    if(!HEADER_FITS(uc_size, ws_align - 1, workspace_size))
+    {
+        return NULL;
+    }
+    size_t total = sizeof(context_blk_t) + uc_size + (ws_align - 1) + workspace_size;
+    context_blk_t *blk = allocate_from(&pool, &total);
+    if(blk)
+    {
+        uintptr_t ws = (uintptr_t)blk->user_context + uc_size;
+        size_t ws_offset = uc_size + ((ws_align - ws % ws_align) % ws_align);
+        fill(blk, pool ? pool->id : CONTEXT_POOL_DEFAULT, func, user_context, uc_size, ws_offset, total, workspace_size, flags);
+    }
+    return blk;
 }
 
-size_t free_context_blk(context_blk_t *blk)
+context_blk_t *package_context_ex(context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size, unsigned flags)
 {
-    free(blk);
+    return package(NULL, func, user_context, uc_size, workspace_size, 1, flags);
 }
-#endif
 
 context_blk_t *package_context(context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size)
 {
-    size_t total = sizeof(context_blk_t) + uc_size + workspace_size;
-    context_blk_t *blk = allocate_space(&total);
-    workspace_size = total - (sizeof(context_blk_t) + uc_size);
-    if(blk)
+    return package(NULL, func, user_context, uc_size, workspace_size, 1, CTX_WS_ZERO_ALL);
+}
+
+context_blk_t *package_context_aligned(context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size, size_t ws_align)
+{
+    return package(NULL, func, user_context, uc_size, workspace_size, ws_align, CTX_WS_ZERO_ALL);
+}
+
+context_blk_t *package_context_in(context_pool_t *pool, context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size)
+{
+    return package(pool, func, user_context, uc_size, workspace_size, 1, CTX_WS_ZERO_ALL);
+}
+
+int context_template_init(context_template_t *tmpl, context_pool_t *pool, context_func_t func, void const *params, size_t uc_size, size_t workspace_size, unsigned flags)
+{
+    context_blk_t *blk = package(pool, func, params, uc_size, workspace_size, 1, (flags & CTX_PRIO_MASK) | CTX_WS_UNINIT);
+    if(!blk)
     {
-        memcpy(blk, 
-            &(context_blk_t){.target_func=func, 
-                             .size=total, 
-                             .workspace_size=workspace_size,
-                             .original_context=user_context,
-                             .workspace=&((uint8_t*)blk->user_context)[uc_size]},
-            sizeof(context_blk_t));
-        memcpy(blk->user_context, user_context, uc_size);
-        memset(&((uint8_t*)blk->user_context)[uc_size], 0, workspace_size);
+        return 0;
+    }
+    tmpl->pool = pool;
+    tmpl->params = params;
+    tmpl->uc_size = uc_size;
+    tmpl->total = blk->size;
+    tmpl->flags = flags;
+    memcpy(tmpl->header, blk, sizeof(context_blk_t));
+    free_context_blk(blk);
+    return 1;
+}
+
+context_blk_t *context_clone(const context_template_t *tmpl, void const *new_params)
+{
+    const context_blk_t *header = (const context_blk_t*)tmpl->header;
+    size_t total = tmpl->total;
+    context_pool_t *pool = tmpl->pool;
+    context_blk_t *blk = allocate_from(&pool, &total);
+    if(!blk)
+    {
+        return NULL;
+    }
+    uint16_t pool_id = pool ? pool->id : CONTEXT_POOL_DEFAULT;
+    if(total != tmpl->total || pool_id != header->pool)  // rounded or placed differently, build the header in full
+    {
+        fill(blk, pool_id, header->target_func, NULL, tmpl->uc_size, tmpl->uc_size, total, header->workspace_request, tmpl->flags);
+#ifndef CONTEXT_NO_ORIGINAL
+        memcpy((void*)&blk->original_context, &tmpl->params, sizeof tmpl->params);
+#endif
+    }
+    else
+    {
+        memcpy(blk, header, sizeof(context_blk_t));
+#ifndef CONTEXT_COMPACT_HEADER
+        void *workspace = &((uint8_t*)blk->user_context)[tmpl->uc_size];
+        memcpy((void*)&blk->workspace, &workspace, sizeof workspace);
+#endif
+        clear_workspace(blk, tmpl->flags);
+    }
+    memcpy(blk->user_context, new_params ? new_params : tmpl->params, tmpl->uc_size);
+    return blk;
+}
+
+#ifdef CONTEXT_WIRE
+// the descriptor is the same 16 bytes on every side, change it on all of them at once
+_Static_assert(sizeof(context_wire_t) == 16, "wire layout");
+_Static_assert(offsetof(context_wire_t, func) == 0, "wire layout");
+_Static_assert(offsetof(context_wire_t, uc_size) == 2, "wire layout");
+_Static_assert(offsetof(context_wire_t, workspace_offset) == 4, "wire layout");
+_Static_assert(offsetof(context_wire_t, resume) == 6, "wire layout");
+_Static_assert(offsetof(context_wire_t, workspace_request) == 8, "wire layout");
+_Static_assert(offsetof(context_wire_t, priority) == 12, "wire layout");
+_Static_assert(offsetof(context_wire_t, reserved) == 13, "wire layout");
+
+static const context_func_t *wire_funcs;
+static uint16_t wire_count;
+
+void context_wire_table(const context_func_t *table, uint16_t n)
+{
+    wire_funcs = table;
+    wire_count = n;
+}
+
+int context_export(const context_blk_t *blk, context_wire_t *wire)
+{
+    size_t ws_offset = (size_t)((uint8_t*)context_workspace(blk) - (uint8_t*)blk->user_context);
+    // run time error, the workspace is padded out too far to describe
+    assert(ws_offset <= UINT16_MAX);
+    for(uint16_t i=0; i<wire_count; i++)
+    {
+        if(wire_funcs[i] == blk->target_func)
+        {
+            *wire = (context_wire_t){.func=i,
+                                     .uc_size=blk->uc_size,
+                                     .workspace_offset=(uint16_t)ws_offset,
+#ifdef CONTEXT_COROUTINE
+                                     .resume=blk->resume,
+#endif
+                                     .workspace_request=blk->workspace_request,
+                                     .priority=(uint8_t)context_priority(blk)};
+            return 1;
+        }
+    }
+    return 0;
+}
+
+context_blk_t *context_import_reserve(context_pool_t *pool, const context_wire_t *wire)
+{
+    return package(pool, NULL, NULL, wire->workspace_offset, wire->workspace_request, 1, CTX_WS_UNINIT);
+}
+
+context_blk_t *context_import(context_blk_t *blk, const context_wire_t *wire)
+{
+    if(wire->func >= wire_count || 
+       sizeof(context_blk_t) + context_wire_payload(wire) > blk->size ||
+       wire->uc_size > wire->workspace_offset)
+    {
+        return NULL;
     }
+    // the payload is already in place, only the header is rebuilt
+    fill(blk, blk->pool, wire_funcs[wire->func], NULL, wire->uc_size, wire->workspace_offset, blk->size, 
+         wire->workspace_request, CTX_WS_UNINIT | CTX_PRIO(wire->priority));
+#ifdef CONTEXT_COROUTINE
+    blk->resume = wire->resume;
+#endif
     return blk;
 }
+#endif
+
+#define ARENA_ALIGN sizeof(uint64_t)  // alignment of every arena closure
+
+void context_arena_init(context_arena_t *arena, void *memory, size_t capacity)
+{
+    size_t skip = (ARENA_ALIGN - (uintptr_t)memory % ARENA_ALIGN) % ARENA_ALIGN;
+    arena->memory = (uint8_t*)memory + skip;
+    arena->capacity = capacity > skip ? capacity - skip : 0;
+    arena->used = 0;
+}
+
+context_blk_t *package_context_arena(context_arena_t *arena, context_func_t func, void const *user_context, size_t uc_size, size_t workspace_size)
+{
+    if(!HEADER_FITS(uc_size, 0, workspace_size))
+    {
+        return NULL;
+    }
+    size_t total = (sizeof(context_blk_t) + uc_size + workspace_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if(total > arena->capacity - arena->used)
+    {
+        return NULL;
+    }
+    context_blk_t *blk = (context_blk_t*)&arena->memory[arena->used];
+    arena->used += total;
+    return fill(blk, CONTEXT_POOL_NONE, func, user_context, uc_size, uc_size, total, workspace_size, CTX_WS_ZERO_ALL);
+}
+
+void context_arena_reset(context_arena_t *arena)
+{
+    arena->used = 0;
+}
+
+// an inline closure must look like a context_blk_t to the wrapper it calls
+_Static_assert(offsetof(context_inline_t, target_func) == offsetof(context_blk_t, target_func), "inline layout");
+#ifndef CONTEXT_NO_ORIGINAL
+_Static_assert(offsetof(context_inline_t, original_context) == offsetof(context_blk_t, original_context), "inline layout");
+#endif
+#ifdef CONTEXT_CHAINS
+_Static_assert(offsetof(context_inline_t, next) == offsetof(context_blk_t, next), "inline layout");
+_Static_assert(offsetof(context_inline_t, upstream) == offsetof(context_blk_t, upstream), "inline layout");
+#endif
+#ifdef CONTEXT_COMPLETION
+_Static_assert(offsetof(context_inline_t, on_done) == offsetof(context_blk_t, on_done), "inline layout");
+_Static_assert(offsetof(context_inline_t, done) == offsetof(context_blk_t, done), "inline layout");
+#endif
+#ifndef CONTEXT_COMPACT_HEADER
+_Static_assert(offsetof(context_inline_t, workspace) == offsetof(context_blk_t, workspace), "inline layout");
+#else
+_Static_assert(offsetof(context_inline_t, workspace_offset) == offsetof(context_blk_t, workspace_offset), "inline layout");
+#endif
+_Static_assert(offsetof(context_inline_t, size) == offsetof(context_blk_t, size), "inline layout");
+_Static_assert(offsetof(context_inline_t, workspace_size) == offsetof(context_blk_t, workspace_size), "inline layout");
+_Static_assert(offsetof(context_inline_t, workspace_request) == offsetof(context_blk_t, workspace_request), "inline layout");
+_Static_assert(offsetof(context_inline_t, pool) == offsetof(context_blk_t, pool), "inline layout");
+_Static_assert(offsetof(context_inline_t, uc_size) == offsetof(context_blk_t, uc_size), "inline layout");
+#ifdef CONTEXT_REFCOUNT
+_Static_assert(offsetof(context_inline_t, refs) == offsetof(context_blk_t, refs), "inline layout");
+#endif
+#ifdef CONTEXT_PRIORITY
+_Static_assert(offsetof(context_inline_t, priority) == offsetof(context_blk_t, priority), "inline layout");
+#endif
+#ifdef CONTEXT_COROUTINE
+_Static_assert(offsetof(context_inline_t, resume) == offsetof(context_blk_t, resume), "inline layout");
+#endif
+_Static_assert(offsetof(context_inline_t, user_context) == offsetof(context_blk_t, user_context), "inline layout");
+
+context_inline_t package_context_inline(context_func_t func, void const *user_context, size_t uc_size)
+{
+    context_inline_t c = {.size=sizeof(context_inline_t), .pool=CONTEXT_POOL_NONE,
+#ifdef CONTEXT_REFCOUNT
+                          .refs=1,
+#endif
+                         };
+    assert(uc_size <= sizeof c.user_context);
+    if(uc_size <= sizeof c.user_context)
+    {
+        c.target_func = func;
+#ifndef CONTEXT_NO_ORIGINAL
+        c.original_context = user_context;
+#endif
+        c.uc_size = (uint16_t)uc_size;
+#ifdef CONTEXT_COMPACT_HEADER
+        c.workspace_offset = (uint16_t)uc_size;
+#endif
+        memcpy(c.user_context, user_context, uc_size);
+    }
+    return c;
+}
+
+void run_context_inline(context_inline_t *c)
+{
+    run_context((context_blk_t*)c);
+}
 
+#ifndef CONTEXT_NO_ORIGINAL
 void reset_context(context_blk_t *blk)
 {
-    memcpy(blk->user_context, blk->original_context, blk->size);
+    if(blk->original_context != NULL)  // packaged without one, e.g. a typed closure
+    {
+        memcpy(blk->user_context, blk->original_context, context_params_size(blk));
+    }
+#ifdef CONTEXT_COROUTINE
+    blk->resume = 0;  // start over from the top
+#endif
 }
 
 void reset_and_clear_context(context_blk_t *blk)
+{
+    reset_and_clear_context_ex(blk, CTX_WS_ZERO_ALL);
+}
+
+void reset_and_clear_context_ex(context_blk_t *blk, unsigned flags)
 {
     reset_context(blk);
-    memset(&((uint8_t*)blk->user_context)[blk->size], 0, blk->workspace_size);
+    clear_workspace(blk, flags);
 }
+#endif
 
 void refresh_context(context_blk_t *blk, void const *user_context)
 {
-    memcpy(blk->user_context, blk->original_context, blk->size);
+    memcpy(blk->user_context, user_context, context_params_size(blk));
+}
+
+void refresh_context_partial(context_blk_t *blk, size_t offset, void const *data, size_t len)
+{
+    // run time error, the update would spill into the workspace
+    assert(offset + len <= context_params_size(blk));
+    if(offset + len <= context_params_size(blk))
+    {
+        memcpy((uint8_t*)blk->user_context + offset, data, len);
+    }
 }
 
 void refresh_and_clear_context(context_blk_t *blk, void const *user_context)
+{
+    refresh_and_clear_context_ex(blk, user_context, CTX_WS_ZERO_ALL);
+}
+
+void refresh_and_clear_context_ex(context_blk_t *blk, void const *user_context, unsigned flags)
 {
     refresh_context(blk,user_context);
-    memset(&((uint8_t*)blk->user_context)[blk->size], 0, blk->workspace_size);
+    clear_workspace(blk, flags);
 }
 
 void run_context(context_blk_t *blk)
 {
-    if(blk->target_func)
+    context_func_t func = blk->target_func;
+    if(func)
     {
-        blk->target_func(blk);
+        TRACE_BEGIN(blk);
+        func(blk);
+        TRACE_END(func);
     }
+    COMPLETE(blk);
 }
 
 void run_context_and_free(context_blk_t *blk)
 {
-    if(blk->target_func)
+    context_func_t func = blk->target_func;
+    if(func)
     {
-        blk->target_func(blk);
+        TRACE_BEGIN(blk);
+        func(blk);
+        TRACE_END(func);
     }
+    COMPLETE(blk);
     free_context_blk(blk);
 }
 
+#ifdef CONTEXT_REFCOUNT
+#ifdef CONTEXT_LOCKFREE
+#define refs_add(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define refs_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#define refs_add(p, v) (*(p) += (v))
+#define refs_load(p) (*(p))
+#endif
+
+context_blk_t *context_retain(context_blk_t *blk)
+{
+    refs_add(&blk->refs, 1);
+    return blk;
+}
+
+void context_release(context_blk_t *blk)
+{
+    // run time error, released more often than retained
+    assert(refs_load(&blk->refs) != 0);
+    if(refs_add(&blk->refs, (uint32_t)-1) == 0)
+    {
+        free_context_blk(blk);
+    }
+}
+
+void run_context_and_release(context_blk_t *blk)
+{
+    run_context(blk);
+    context_release(blk);
+}
+
+uint32_t context_refs(const context_blk_t *blk)
+{
+    return refs_load(&blk->refs);
+}
+#endif
+
+#ifdef CONTEXT_COMPLETION
+static void complete(context_blk_t *blk)
+{
+#ifdef CONTEXT_COROUTINE
+    if(blk->resume != 0 && blk->resume != CTX_CORO_DONE)
+    {
+        return;  // suspended at a yield, it has not finished
+    }
+#endif
+    if(blk->on_done)
+    {
+        blk->on_done(blk);
+    }
+    // publishes everything the run wrote, pairs with context_is_done()
+    __atomic_store_n(&blk->done, 1, __ATOMIC_RELEASE);
+}
+
+int context_is_done(const context_blk_t *blk)
+{
+    return __atomic_load_n(&blk->done, __ATOMIC_ACQUIRE);
+}
+
+void context_wait(const context_blk_t *blk)
+{
+    while(!context_is_done(blk))
+    {
+        CONTEXT_WAIT_PAUSE();
+    }
+}
+
+void context_on_done(context_blk_t *blk, context_func_t callback)
+{
+    blk->on_done = callback;
+}
+
+void context_rearm(context_blk_t *blk)
+{
+    __atomic_store_n(&blk->done, 0, __ATOMIC_RELAXED);
+}
+#endif
+
+#ifdef CONTEXT_CHAINS
+context_blk_t *context_then(context_blk_t *a, context_blk_t *b)
+{
+    a->next = b;
+    return b;
+}
+
+void run_context_chain(context_blk_t *head)
+{
+    context_blk_t *prev = NULL;
+    for(context_blk_t *blk = head; blk; blk = blk->next)
+    {
+        blk->upstream = prev;
+        run_context(blk);
+        if(prev)
+        {
+            free_context_blk(prev);  // its output has been consumed
+        }
+        prev = blk;
+    }
+    if(prev)
+    {
+        free_context_blk(prev);
+    }
+}
+#endif
+
+void run_context_batch(context_blk_t **blks, size_t n, int free_after)
+{
+    size_t i = 0;
+    while(i < n)
+    {
+        context_func_t func = blks[i]->target_func;
+        do  // the stretch of closures sharing a target
+        {
+            if(i + 1 < n)
+            {
+                __builtin_prefetch(blks[i + 1]);
+                __builtin_prefetch(blks[i + 1]->user_context);
+            }
+            if(func)
+            {
+                TRACE_BEGIN(blks[i]);
+                func(blks[i]);
+                TRACE_END(func);
+            }
+            COMPLETE(blks[i]);
+            i++;
+        } while(i < n && blks[i]->target_func == func);
+    }
+    if(free_after)
+    {
+        free_context_batch(blks, n);
+    }
+}
+
+#ifndef CONTEXT_NO_ORIGINAL
 void reset_and_run_context(context_blk_t *blk)
 {
     reset_context(blk);
     run_context(blk);
-}
\ No newline at end of file
+}
+#endif
@@ -29,7 +29,7 @@
  * {
  *      my_found_support_t *parms = (my_found_support_t *)context->user_context;    
  *      // use special allocated  buffer
- *      parms->buffer = context->workspace;
+ *      parms->buffer = context_workspace(context);
  *      parms->buf_size = context->workspace_size;
  *      parms->ret_val = my_found_function(parms->parm1, parms->buffer, parms->buf_size);
  * }
@@ -64,17 +64,71 @@
 typedef struct context_blk_t context_blk_t;
 // wrapper prototype
 typedef void (*context_func_t)(context_blk_t *context);
+/*
+    CONTEXT_COMPACT_HEADER trades the workspace pointer and the size_t sizes
+    for 32 bit sizes, a 16 bit workspace request and a workspace offset, 32
+    bytes of header on 64 bit targets where the full one is 48.  
+    CONTEXT_NO_ORIGINAL then also drops the original_context pointer (and
+    with it the reset functions) for 24.  Reach the workspace through
+    context_workspace(), which works with either layout.
+*/
+#if defined(CONTEXT_NO_ORIGINAL) && !defined(CONTEXT_COMPACT_HEADER)
+#error "CONTEXT_NO_ORIGINAL is a CONTEXT_COMPACT_HEADER option"
+#endif
+
+#ifndef CONTEXT_CACHE_LINE
+#define CONTEXT_CACHE_LINE 64   // bytes, size of the false sharing unit
+#endif
+
 // the wrapper structure
 typedef struct context_blk_t
 {
     const context_func_t target_func;    // the function
+#ifndef CONTEXT_NO_ORIGINAL
     const void * const original_context; // pointer to original parameters
+#endif
+#ifdef CONTEXT_CHAINS
+    context_blk_t *next;                 // stage run after this one, see context_then()
+    context_blk_t *upstream;             // stage that ran before this one, while in a chain
+#endif
+#ifdef CONTEXT_COMPLETION
+    context_func_t on_done;              // called after every run, see context_on_done()
+#endif
+#ifndef CONTEXT_COMPACT_HEADER
     void * const workspace;              // pointer to workspace
-    const size_t size;                   // size of the parameters
+    const size_t size;                   // size of the whole block
     const size_t workspace_size;         // extra usable space
+    const uint32_t workspace_request;    // workspace asked for, before rounding up
+#else
+    const uint32_t size;                 // size of the whole block
+    const uint32_t workspace_size;       // extra usable space
+    const uint16_t workspace_request;    // workspace asked for, before rounding up
+    const uint16_t workspace_offset;     // workspace start within user_context
+#endif
+    const uint16_t pool;                 // id of the owning pool
+    const uint16_t uc_size;              // size of the parameters
+#ifdef CONTEXT_REFCOUNT
+    uint32_t refs;                       // holders, freed when the last releases
+#endif
+#ifdef CONTEXT_PRIORITY
+    const uint8_t priority;              // dispatch level, see CTX_PRIO()
+#endif
+#ifdef CONTEXT_COROUTINE
+    uint16_t resume;                     // where the wrapper continues, see context_coro.h
+#endif
+#ifdef CONTEXT_COMPLETION
+    uint8_t done;                        // set once a run has returned, see context_is_done()
+#endif
     uint64_t user_context[];  // location of copied data and requested workspace
 } context_blk_t;
 
+#ifndef CONTEXT_COMPACT_HEADER
+#define context_workspace(blk) ((blk)->workspace)
+#else
+#define context_workspace(blk) ((void*)((uint8_t*)(blk)->user_context + (blk)->workspace_offset))
+#endif
+#define context_params_size(blk) ((size_t)(blk)->uc_size)
+
 /*
     Typical user context structure may contain a open block at the end for the 
     workspace.
@@ -101,16 +155,360 @@ typedef struct context_blk_t
 
 */
 
+/*
+    Small closures can skip the allocator altogether.  A context_inline_t is a
+    value: built on the stack, copied by assignment into a queue or array,
+    and run in place.  It starts with the same fields as context_blk_t, so
+    the wrapper function is an ordinary context_func_t; it has no workspace
+    and it is never freed.
+*/
+#ifndef CONTEXT_INLINE_SIZE
+#define CONTEXT_INLINE_SIZE 32  // bytes of parameters a context_inline_t carries
+#endif
+
+typedef struct context_inline_t
+{
+    context_func_t target_func;
+#ifndef CONTEXT_NO_ORIGINAL
+    const void *original_context;
+#endif
+#ifdef CONTEXT_CHAINS
+    context_blk_t *next;
+    context_blk_t *upstream;
+#endif
+#ifdef CONTEXT_COMPLETION
+    context_func_t on_done;
+#endif
+#ifndef CONTEXT_COMPACT_HEADER
+    void *workspace;                    // always NULL
+    size_t size;                        // sizeof(context_inline_t)
+    size_t workspace_size;              // always 0
+    uint32_t workspace_request;         // always 0
+#else
+    uint32_t size;
+    uint32_t workspace_size;
+    uint16_t workspace_request;
+    uint16_t workspace_offset;          // uc_size, the empty workspace is at the end
+#endif
+    uint16_t pool;                      // CONTEXT_POOL_NONE
+    uint16_t uc_size;
+#ifdef CONTEXT_REFCOUNT
+    uint32_t refs;
+#endif
+#ifdef CONTEXT_PRIORITY
+    uint8_t priority;
+#endif
+#ifdef CONTEXT_COROUTINE
+    uint16_t resume;
+#endif
+#ifdef CONTEXT_COMPLETION
+    uint8_t done;
+#endif
+    uint64_t user_context[(CONTEXT_INLINE_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+} context_inline_t;
+
 /**
  * @brief build a closure structure for a function and some data
  * 
  * @param func      function to be wrapped
  * @param user_context data to be copied into the closure (copied not ref)
+ * @param uc_size   the size of the copied data, at most 65535
+ * @param workspace   any additional workspace requested, at most 65535 
+ *                  with CONTEXT_COMPACT_HEADER
+ * @return context_blk_t* NULL if memory error or a size is over its limit,
+ *  or pointer to the closure.
+ */
+context_blk_t *package_context(context_func_t func, void const *user_context, size_t uc_size, size_t workspace);
+
+/*
+    Workspace initialisation options.  The workspace is rounded up to fill
+    the block, so clearing all of it can cost far more than the request.
+*/
+#define CTX_WS_ZERO_ALL             0u  // clear the whole workspace (package_context default)
+#define CTX_WS_ZERO_REQUESTED_ONLY  1u  // clear only the bytes that were asked for
+#define CTX_WS_UNINIT               2u  // leave the workspace as found
+#define CTX_WS_MASK                 3u
+
+/*
+    With CONTEXT_PRIORITY a closure carries a dispatch level given in the 
+    flags of package_context_ex(), honoured by ctx_prio_queue_t.  Higher
+    is more urgent, package_context() gives level 0.  Without the option
+    the level bits are ignored and every closure is level 0.
+*/
+#define CTX_PRIO_SHIFT              4
+#define CTX_PRIO_MASK               (0xFu << CTX_PRIO_SHIFT)
+#define CTX_PRIO(level)             (((unsigned)(level) << CTX_PRIO_SHIFT) & CTX_PRIO_MASK)
+#ifdef CONTEXT_PRIORITY
+#define context_priority(blk) ((unsigned)(blk)->priority)
+#else
+#define context_priority(blk) 0u
+#endif
+
+/**
+ * @brief package_context() with a choice of workspace initialisation
+ * 
+ * @param func      function to be wrapped
+ * @param user_context data to be copied into the closure (copied not ref), 
+ *                  NULL to leave uc_size bytes for the caller to fill in
  * @param uc_size   the size of the copied data
  * @param workspace   any additional workspace requested
+ * @param flags     one of the CTX_WS_ options, or'ed with CTX_PRIO(level)
  * @return context_blk_t* NULL if memory error or pointer to the closure.
  */
-context_blk_t *package_context(context_func_t func, void const *user_context, size_t uc_size, size_t workspace);
+context_blk_t *package_context_ex(context_func_t func, void const *user_context, size_t uc_size, size_t workspace, unsigned flags);
+
+/**
+ * @brief package_context() with the workspace padded out to a boundary, 
+ *  for SIMD or DMA buffers.  The padding sits between the parameters and 
+ *  the workspace, so reset and refresh still copy only uc_size bytes.
+ *  Blocks of the built in pool start on a CONTEXT_CACHE_LINE boundary
+ *  when CONTEXT_BLK_SIZE is a multiple of it, as the default is; the
+ *  padding is worked out from the address either way.
+ * 
+ * @param func      function to be wrapped
+ * @param user_context data to be copied into the closure (copied not ref)
+ * @param uc_size   the size of the copied data
+ * @param workspace   any additional workspace requested
+ * @param ws_align  workspace boundary in bytes, a power of 2 such as 16, 32 or 64
+ * @return context_blk_t* NULL if memory error or pointer to the closure.
+ */
+context_blk_t *package_context_aligned(context_func_t func, void const *user_context, size_t uc_size, size_t workspace, size_t ws_align);
+
+/*
+    Besides the built in pool, closures can come from pools laid over memory
+    the caller supplies, each with its own block size and block count.  A 
+    pool starts with its bitmap, so give it CONTEXT_POOL_MEMORY() bytes,
+    8 byte aligned.  Every closure records its pool's id so free_context_blk()
+    returns it to the right place.
+
+    static uint64_t sensor_memory[CONTEXT_POOL_MEMORY(128, 32) / sizeof(uint64_t)];
+    static context_pool_t sensor_pool;
+    context_pool_init(&sensor_pool, sensor_memory, 128, 32);
+    context_blk_t *blk = package_context_in(&sensor_pool, sensor_wrapper, &reading, sizeof reading, 0);
+*/
+#ifndef CONTEXT_MAX_POOLS
+#define CONTEXT_MAX_POOLS 8         // pools that may exist at once, the default included
+#endif
+#define CONTEXT_POOL_DEFAULT 0      // id of the built in pool
+#ifndef CONTEXT_BLK_SIZE
+#define CONTEXT_BLK_SIZE 256        // bytes per block of the built in pool, a multiple of 8
+#endif
+#define CONTEXT_POOL_NONE 0xFFFFu   // closures not freed one by one (inline, arena)
+
+#define CONTEXT_POOL_BITMAP_BYTES(count) ((((count) + 63) / 64) * sizeof(uint64_t))
+#define CONTEXT_POOL_MEMORY(blk_size, count) (CONTEXT_POOL_BITMAP_BYTES(count) + (size_t)(blk_size) * (count))
+
+/*
+    With CONTEXT_STATS each pool keeps occupancy counters, cheap enough for
+    the hot path (relaxed atomic adds with CONTEXT_LOCKFREE, plain adds 
+    otherwise).  Without it they are compiled out entirely.  Buckets are
+    powers of two: bucket b counts values 2^b to 2^(b+1)-1, bucket 0 also
+    takes 0 and the last bucket takes everything above.
+*/
+#ifndef CONTEXT_STATS_BUCKETS
+#define CONTEXT_STATS_BUCKETS 8
+#endif
+
+typedef struct context_pool_stats_t
+{
+    uint32_t blocks_in_use;     // blocks handed out now
+    uint32_t peak_blocks_in_use;
+    uint32_t largest_free_run;  // blocks in the longest free run, at the time of the query
+    uint32_t allocations;
+    uint32_t alloc_failures[CONTEXT_STATS_BUCKETS];  // by blocks requested
+    uint32_t scan_cost[CONTEXT_STATS_BUCKETS];       // by free runs examined per allocation
+} context_pool_stats_t;
+
+typedef struct context_pool_t
+{
+    uint8_t *blocks;        // first block
+    void *in_use;           // bitmap, one bit per block
+    size_t blk_size;        // bytes per block
+    size_t count;           // number of blocks
+    uint16_t id;            // written into the header of each closure
+#ifdef CONTEXT_STATS
+    context_pool_stats_t stats;
+#endif
+} context_pool_t;
+
+/**
+ * @brief lay a pool over caller memory and register it
+ * 
+ * @param pool pool object, must outlive its closures
+ * @param memory CONTEXT_POOL_MEMORY(blk_size, count) bytes, 8 byte aligned
+ * @param blk_size bytes per block, a multiple of 8 larger than the header
+ * @param count number of blocks
+ * @return int 1 on success, 0 if CONTEXT_MAX_POOLS are already registered
+ */
+int context_pool_init(context_pool_t *pool, void *memory, size_t blk_size, size_t count);
+
+/**
+ * @brief unregister a pool, all of its closures must have been freed
+ * 
+ * @param pool the pool
+ */
+void context_pool_deinit(context_pool_t *pool);
+
+/*
+    Memory shared with another core or process can hold a pool that every
+    side attaches to by the same id, then any side may package into it and
+    free whatever the others packaged (the bitmap must be shared safely, so
+    build with CONTEXT_LOCKFREE).  Every side, the one that creates the
+    pool included, registers it with context_pool_attach() and the id agreed
+    between them; context_pool_init() picks its own id and is not for
+    shared memory.  The creator zeroes the first
+    CONTEXT_POOL_BITMAP_BYTES(count) bytes (an empty bitmap) before any
+    side attaches, as context_shm_pool_open() does.  Closures are handed
+    over as offsets, which mean the same wherever the memory is mapped.
+    original_context points into the packaging side's memory, so
+    reset_context() is only meaningful there.  See context_shm.h for POSIX
+    shared memory.
+*/
+
+/**
+ * @brief register a pool over memory that already holds one, the bitmap is
+ *  kept as found
+ * 
+ * @param pool pool object of this side
+ * @param memory CONTEXT_POOL_MEMORY(blk_size, count) bytes, 8 byte aligned
+ * @param blk_size bytes per block, as every side uses
+ * @param count number of blocks, as every side uses
+ * @param id id every side registers the pool with, 1 to CONTEXT_MAX_POOLS-1
+ * @return int 1 on success, 0 if the id is taken
+ */
+int context_pool_attach(context_pool_t *pool, void *memory, size_t blk_size, size_t count, uint16_t id);
+
+/**
+ * @brief position of a closure in its pool, to hand over
+ * 
+ * @param pool the pool
+ * @param blk a closure of the pool
+ * @return size_t bytes from the first block
+ */
+size_t context_pool_offset(const context_pool_t *pool, const context_blk_t *blk);
+
+/**
+ * @brief the closure at an offset from context_pool_offset()
+ * 
+ * @param pool the pool, as attached on this side
+ * @param offset bytes from the first block
+ * @return context_blk_t* NULL if offset is not the start of a block
+ */
+context_blk_t *context_pool_at(const context_pool_t *pool, size_t offset);
+
+#ifdef CONTEXT_STATS
+/**
+ * @brief snapshot the counters of a pool.  The default pool includes its 
+ *  size class slots in the block counts; built with USE_MALLOC a block of 
+ *  the default pool is one closure and it has no free runs.
+ * 
+ * @param pool the pool, NULL for the default pool
+ * @param out filled with the counters
+ */
+void context_pool_stats(const context_pool_t *pool, context_pool_stats_t *out);
+#endif
+
+/**
+ * @brief package_context() from a given pool
+ * 
+ * @param pool pool to allocate from
+ * @return context_blk_t* NULL if the pool has no room
+ */
+context_blk_t *package_context_in(context_pool_t *pool, context_func_t func, void const *user_context, size_t uc_size, size_t workspace);
+
+/*
+    An arena hands out closures by bumping a pointer through a buffer, for
+    closures that all die together (one request, one packet).  Nothing is
+    searched and nothing is kept per closure; free_context_blk() on an arena
+    closure does nothing and context_arena_reset() drops them all at once.
+    The buffer can be any memory, including the workspace of a closure from
+    a pool.  An arena has one owner, it is not safe to share between threads.
+
+    static uint64_t packet_memory[512];
+    context_arena_t arena;
+    context_arena_init(&arena, packet_memory, sizeof packet_memory);
+    blk = package_context_arena(&arena, reply_wrapper, &hdr, sizeof hdr, 0);
+    ...
+    context_arena_reset(&arena);  // packet done
+*/
+typedef struct context_arena_t
+{
+    uint8_t *memory;
+    size_t capacity;        // bytes
+    size_t used;            // bytes handed out
+} context_arena_t;
+
+/**
+ * @brief lay an empty arena over caller memory
+ * 
+ * @param arena arena object
+ * @param memory buffer, aligned up to 8 bytes if it is not
+ * @param capacity bytes in the buffer
+ */
+void context_arena_init(context_arena_t *arena, void *memory, size_t capacity);
+
+/**
+ * @brief package_context() from an arena
+ * 
+ * @param arena arena to bump
+ * @return context_blk_t* NULL if the arena has no room
+ */
+context_blk_t *package_context_arena(context_arena_t *arena, context_func_t func, void const *user_context, size_t uc_size, size_t workspace);
+
+/**
+ * @brief release every closure of an arena.  None of them may be used
+ *  afterwards.
+ * 
+ * @param arena the arena
+ */
+void context_arena_reset(context_arena_t *arena);
+
+/*
+    A template fixes the function, parameter layout, workspace and pool of a
+    closure that is sent over and over with different values.  Each clone
+    takes its header from the template as one fixed size copy and its 
+    parameters as one copy, and clears its workspace only if the template
+    asks.  The template's parameters stay the original_context of every
+    clone, so reset_context() puts a clone back to the template values.
+
+    static const sample_t defaults = {.channel = 3};
+    context_template_t sample_tmpl;
+    context_template_init(&sample_tmpl, NULL, sample_wrapper, &defaults, sizeof defaults, 0, CTX_WS_UNINIT);
+    ctx_queue_push(&q, context_clone(&sample_tmpl, &reading));
+*/
+typedef struct context_template_t
+{
+    context_pool_t *pool;       // NULL for the default pool
+    const void *params;         // pristine parameters, must outlive the template
+    size_t uc_size;
+    size_t total;               // bytes of each clone's block
+    unsigned flags;             // CTX_WS_ option for each clone
+    uint64_t header[(sizeof(context_blk_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+} context_template_t;
+
+/**
+ * @brief prepare a template.  One closure is packaged and freed to learn
+ *  the block size, so the pool must have room for one.
+ * 
+ * @param tmpl template object
+ * @param pool pool the clones come from, NULL for the default pool
+ * @param func function to be wrapped
+ * @param params default parameters, kept by reference
+ * @param uc_size the size of the parameters
+ * @param workspace workspace each clone gets
+ * @param flags CTX_WS_ option applied to each clone's workspace
+ * @return int 1 on success, 0 if no closure could be allocated
+ */
+int context_template_init(context_template_t *tmpl, context_pool_t *pool, context_func_t func, void const *params, size_t uc_size, size_t workspace, unsigned flags);
+
+/**
+ * @brief allocate a closure shaped by a template
+ * 
+ * @param tmpl prepared template, only read so it may be shared
+ * @param new_params uc_size bytes of parameters, NULL for the template's own
+ * @return context_blk_t* NULL if memory error or pointer to the closure.
+ */
+context_blk_t *context_clone(const context_template_t *tmpl, void const *new_params);
 
 /**
  * @brief free an allocated closure structure
@@ -119,6 +517,93 @@ context_blk_t *package_context(context_func_t func, void const *user_context, si
  */
 void free_context_blk(context_blk_t *blk);
 
+/**
+ * @brief free a set of closures at once.  Blocks from the static pool are 
+ *  gathered into one update of each bitmap word they touch.
+ * 
+ * @param blks array of closure pointers
+ * @param n number of closures in blks
+ */
+void free_context_batch(context_blk_t **blks, size_t n);
+
+// heap hooks, the free hook is told the size that was allocated
+typedef void *(*ctx_alloc_t)(size_t size);
+typedef void (*ctx_free_t)(void *ptr, size_t size);
+
+#ifdef USE_MALLOC
+/*
+    Built with USE_MALLOC the default pool is a heap, malloc() and free()
+    unless the application plugs in another (rpmalloc, mimalloc, an RTOS
+    heap) before the first closure is packaged.  The free hook is given the
+    size that was allocated, so a sized heap needs no lookup.  Requests are
+    rounded up to CONTEXT_HEAP_ALIGN and each closure must be at least 8
+    byte aligned.  Pools from context_pool_init() stay static alongside it.
+
+    static void *rt_alloc(size_t size) { return rpmalloc(size); }
+    static void rt_free(void *ptr, size_t size) { rpfree(ptr); }
+    context_set_heap(rt_alloc, rt_free);
+*/
+#ifndef CONTEXT_HEAP_ALIGN
+#define CONTEXT_HEAP_ALIGN 16   // granule of the heap, a power of 2
+#endif
+
+/**
+ * @brief choose the heap of the default pool
+ * 
+ * @param alloc allocation hook, NULL for malloc()
+ * @param release sized free hook, NULL for free()
+ */
+void context_set_heap(ctx_alloc_t alloc, ctx_free_t release);
+#endif
+
+#ifdef CONTEXT_GROW
+/*
+    With CONTEXT_GROW the built in pool grows under load instead of 
+    returning NULL.  When it is full a segment of CONTEXT_SEGMENT_BLKS blocks
+    is taken from the segment heap and registered as a pool of its own, so
+    free_context_blk() finds it from the header's pool id like any pool.
+    Packaging tries the segment that last had room first.  Up to 
+    CONTEXT_SEGMENTS segments exist at once, each takes a pool id for good,
+    and no closure larger than a segment spills over.
+
+    Only one context grows at a time, another that finds the pool full 
+    meanwhile gets NULL rather than waiting, which keeps interrupts safe if
+    the segment heap is.  context_pool_trim() gives idle segments back.
+*/
+#ifndef CONTEXT_SEGMENTS
+#define CONTEXT_SEGMENTS 4          // at most 32, fewer than CONTEXT_MAX_POOLS
+#endif
+#ifndef CONTEXT_SEGMENT_BLKS
+#define CONTEXT_SEGMENT_BLKS 64     // blocks of CONTEXT_BLK_SIZE per segment
+#endif
+
+/**
+ * @brief choose where segments come from, before the pool first grows
+ * 
+ * @param alloc allocation hook, CONTEXT_CACHE_LINE aligned, NULL for 
+ *  aligned_alloc()
+ * @param release sized free hook, NULL for free()
+ */
+void context_set_segment_heap(ctx_alloc_t alloc, ctx_free_t release);
+
+/**
+ * @brief return every segment with no closure in it to the segment heap.
+ *  Safe alongside packaging and freeing; does nothing if the pool is
+ *  growing at that moment.
+ * 
+ * @return size_t number of segments released
+ */
+size_t context_pool_trim(void);
+#endif
+
+#ifdef CONTEXT_THREAD_CACHE
+/**
+ * @brief hand every slot cached by the calling thread back to the shared 
+ *  size class lists, call before a thread that used the pool exits.
+ */
+void context_thread_cache_flush(void);
+#endif
+
 /**
  * @brief run the closure, run the enclosed function with the data originally copied 
  *  and the allocated memory. Any changes to the original data or the workspace
@@ -137,30 +622,304 @@ void run_context(context_blk_t *blk);
  */
 void run_context_and_free(context_blk_t *blk);
 
+#ifdef CONTEXT_CHAINS
+/*
+    With CONTEXT_CHAINS closures can be linked into a pipeline that runs as
+    one unit, so it costs one trip through a queue however many stages it
+    has.  While a stage runs, context_upstream() is the stage before it, 
+    whose user_context and workspace it may read as its input in place.  
+    Each stage is freed as soon as the stage after it has finished.
+
+    context_then(context_then(parse, filter), publish);
+    ctx_queue_push(&q, parse);
+    ...
+    ctx_queue_drain(&q, run_context_chain);
+*/
+#define context_upstream(blk) ((blk)->upstream)
+
+/**
+ * @brief make b the stage that runs after a
+ * 
+ * @param a upstream stage
+ * @param b downstream stage, NULL to end the chain at a
+ * @return context_blk_t* b, so further stages can be appended
+ */
+context_blk_t *context_then(context_blk_t *a, context_blk_t *b);
+
+/**
+ * @brief run a chain from its first stage to its last, freeing each stage
+ *  once its successor has run and the last when it is done.  A closure 
+ *  with no successor is run and freed like run_context_and_free().
+ * 
+ * @param head first stage
+ */
+void run_context_chain(context_blk_t *head);
+#endif
+
+#ifdef CONTEXT_REFCOUNT
+/*
+    With CONTEXT_REFCOUNT a closure counts its holders, starting at one for
+    whoever packaged it.  A long lived closure can then be queued again and
+    again with no allocation: take a reference for the queue, and the 
+    consumer gives it back after the run.  Counting is atomic with 
+    CONTEXT_LOCKFREE.
+
+    context_blk_t *tick = package_context(control_wrapper, &loop, sizeof loop, 0);
+    // every period
+    if(context_refs(tick) == 1)     // not still in flight from the last period
+    {
+        ctx_queue_push(&q, context_retain(tick));
+    }
+    // consumer
+    ctx_queue_drain(&q, run_context_and_release);
+*/
+
+/**
+ * @brief take another reference to a closure
+ * 
+ * @param blk the closure
+ * @return context_blk_t* blk
+ */
+context_blk_t *context_retain(context_blk_t *blk);
+
+/**
+ * @brief give up a reference, the last one frees the closure
+ * 
+ * @param blk the closure
+ */
+void context_release(context_blk_t *blk);
+
+/**
+ * @brief run the closure then give up a reference, the queue safe 
+ *  counterpart of run_context_and_free()
+ * 
+ * @param blk pointer to closure structure.
+ */
+void run_context_and_release(context_blk_t *blk);
+
+/**
+ * @brief number of references held now
+ */
+uint32_t context_refs(const context_blk_t *blk);
+#endif
+
+#ifdef CONTEXT_COMPLETION
+/*
+    With CONTEXT_COMPLETION a closure doubles as a future.  Once target_func
+    returns, the optional completion callback runs and then the done flag is
+    set with a release store, so whatever the function left in its 
+    parameters or workspace (its ret_val) is visible to a caller that sees
+    context_is_done().  Setting it is one store, the runner never waits.
+
+    context_blk_t *job = package_context(crc_wrapper, &args, sizeof args, 0);
+    ctx_queue_push(&q, job);
+    ...
+    context_wait(job);
+    uint32_t crc = ((crc_args_t*)job->user_context)->ret_val;
+    free_context_blk(job);
+
+    Every run path sets the flag, including run_context_and_free(), but a
+    freed closure must not be waited on; use the callback there, or keep the
+    closure alive with a reference (CONTEXT_REFCOUNT).  Before queueing the
+    same closure again call context_rearm().  A coroutine (CONTEXT_COROUTINE)
+    is only done once it reaches CTX_CORO_END, not when it yields.
+
+    context_wait() checks the flag in a loop and between checks runs 
+    CONTEXT_WAIT_PAUSE(): a cpu relax hint by default, sched_yield() with 
+    CONTEXT_WAIT_YIELD, or anything the port defines, for example taking an
+    RTOS event that the completion callback gives.
+*/
+
+/**
+ * @brief has the closure finished a run since it was packaged or rearmed
+ * 
+ * @param blk the closure
+ * @return int non-zero once done, acquire ordered with the run
+ */
+int context_is_done(const context_blk_t *blk);
+
+/**
+ * @brief block until the closure has finished, see CONTEXT_WAIT_PAUSE()
+ * 
+ * @param blk the closure, it must not be freed by the run
+ */
+void context_wait(const context_blk_t *blk);
+
+/**
+ * @brief set the function called with the closure when a run returns, 
+ *  before it is marked done.  It runs on the thread that ran the closure.
+ * 
+ * @param blk the closure
+ * @param callback function to call, NULL for none
+ */
+void context_on_done(context_blk_t *blk, context_func_t callback);
+
+/**
+ * @brief clear the done flag before submitting the closure again
+ * 
+ * @param blk the closure
+ */
+void context_rearm(context_blk_t *blk);
+#endif
+
+#ifdef CONTEXT_WIRE
+/*
+    With CONTEXT_WIRE a closure can move to another core or processor that
+    runs the same build.  Its pointers mean nothing there, so it travels as
+    a small descriptor, with the function as an index into a table every
+    side registers in the same order and the workspace as an offset, plus
+    the payload: the user_context bytes verbatim, parameters then the 
+    requested workspace.  The payload is sent straight from the closure and
+    lands straight in a block of the receiving pool, nothing is copied 
+    through a buffer.
+
+    // both sides
+    static const context_func_t wire_funcs[] = {crc_wrapper, led_wrapper};
+    context_wire_table(wire_funcs, 2);
+    // sender
+    context_wire_t wire;
+    context_export(blk, &wire);
+    mailbox_send(&wire, sizeof wire);
+    dma_start(remote, blk->user_context, context_wire_payload(&wire));
+    // receiver, once the descriptor arrives
+    context_blk_t *blk = context_import_reserve(NULL, &wire);
+    dma_start(blk->user_context, remote, context_wire_payload(&wire));
+    // and once the payload arrives
+    run_context_and_free(context_import(blk, &wire));
+
+    An imported closure has no original_context, links, callback or extra
+    references, and an aligned workspace keeps its offset, not its alignment.
+*/
+// fixed 16 byte layout, host byte order, pinned by static asserts in context.c
+typedef struct context_wire_t
+{
+    uint16_t func;              // index of target_func in the function table
+    uint16_t uc_size;           // bytes of parameters
+    uint16_t workspace_offset;  // workspace start within the payload
+    uint16_t resume;            // coroutine position, 0 without CONTEXT_COROUTINE
+    uint32_t workspace_request; // workspace bytes in the payload
+    uint8_t priority;           // dispatch level, 0 without CONTEXT_PRIORITY
+    uint8_t reserved[3];
+} context_wire_t;
+
+// bytes of user_context that travel with a descriptor
+#define context_wire_payload(wire) ((size_t)(wire)->workspace_offset + (wire)->workspace_request)
+
+/**
+ * @brief register the function table, identical on every side
+ * 
+ * @param table functions closures may be sent with, must outlive its use
+ * @param n number of entries
+ */
+void context_wire_table(const context_func_t *table, uint16_t n);
+
+/**
+ * @brief describe a closure for sending, the closure itself is unchanged
+ * 
+ * @param blk the closure, its payload starts at blk->user_context
+ * @param wire filled with the descriptor
+ * @return int 1 on success, 0 if target_func is not in the table
+ */
+int context_export(const context_blk_t *blk, context_wire_t *wire);
+
+/**
+ * @brief take a block to receive a payload into, at its user_context
+ * 
+ * @param pool pool to allocate from, NULL for the default pool
+ * @param wire descriptor of the closure on its way
+ * @return context_blk_t* NULL if the pool has no room, otherwise an empty
+ *  closure that runs nothing until context_import()
+ */
+context_blk_t *context_import_reserve(context_pool_t *pool, const context_wire_t *wire);
 
+/**
+ * @brief turn a block holding a received payload into the closure, in 
+ *  place.  The block keeps its own pool and size.
+ * 
+ * @param blk block from context_import_reserve(), or any closure of the 
+ *  pool with room for the payload
+ * @param wire descriptor the payload came with
+ * @return context_blk_t* blk, or NULL if the function index is unknown or
+ *  the payload does not fit the block
+ */
+context_blk_t *context_import(context_blk_t *blk, const context_wire_t *wire);
+#endif
+
+/**
+ * @brief run a set of closures in order, as a dispatcher draining a queue
+ *  would.  The next closure is prefetched while the current one runs, and 
+ *  neighbours with the same target_func are called back to back through one
+ *  function pointer so the indirect branch stays predictable.
+ * 
+ * @param blks array of closure pointers
+ * @param n number of closures in blks
+ * @param free_after non-zero to free every closure once the batch has run,
+ *      with free_context_batch()
+ */
+void run_context_batch(context_blk_t **blks, size_t n, int free_after);
+
+/**
+ * @brief build an inline closure by value, no allocation.
+ * 
+ * @param func      function to be wrapped
+ * @param user_context data to be copied into the closure (copied not ref)
+ * @param uc_size   the size of the copied data, at most CONTEXT_INLINE_SIZE
+ * @return context_inline_t the closure, its target_func is NULL (run does 
+ *  nothing) if uc_size is too large
+ */
+context_inline_t package_context_inline(context_func_t func, void const *user_context, size_t uc_size);
+
+/**
+ * @brief run an inline closure, any changes it makes to its parameters stay
+ *  in that copy of the closure.
+ * 
+ * @param c pointer to the inline closure
+ */
+void run_context_inline(context_inline_t *c);
+
+#ifndef CONTEXT_NO_ORIGINAL  // resets need the original parameters
 /**
  * @brief reset the context to original state using original pointer to user_context,
  *  and clear the workspace back to zero.
  *  This assumes that the original user_context was constant and still exists, or 
- *  is at least still meaningful. 
+ *  is at least still meaningful.  A closure packaged with a NULL user_context
+ *  (DEFINE_CONTEXT() closures among them) has no original, its parameters
+ *  are left as they are.
  * 
  * @param blk pointer to previous created context blk
  */
 void reset_and_clear_context(context_blk_t *blk);
-// same as above but does not clear the workspace
+// same as above with a choice of CTX_WS_ option for the workspace
+void reset_and_clear_context_ex(context_blk_t *blk, unsigned flags);
+// same as above but does not clear the workspace (a coroutine starts over too)
 void reset_context(context_blk_t *blk);
 
+#endif
+
 /**
  * @brief update teh user context with a new set of values.  This does not
  *  reset the pointer to the original dataset, and does not clear the workspace.
  * 
  * @param blk - pointer to previously created context
- * @param user_context pointer to new set of data or original size
+ * @param user_context pointer to new set of data of the original size
  */
 void refresh_context(context_blk_t *blk, void const *user_context);
+/**
+ * @brief update some of the parameters in place, for example one field
+ *  with offsetof()
+ * 
+ * @param blk - pointer to previously created context
+ * @param offset first byte to update within the parameters
+ * @param data new bytes
+ * @param len number of bytes, offset + len must be within the parameters
+ */
+void refresh_context_partial(context_blk_t *blk, size_t offset, void const *data, size_t len);
 // same as above but also clear the workspace
 void refresh_and_clear_context(context_blk_t *blk, void const *user_context);
+// same as above with a choice of CTX_WS_ option for the workspace
+void refresh_and_clear_context_ex(context_blk_t *blk, void const *user_context, unsigned flags);
 
+#ifndef CONTEXT_NO_ORIGINAL
 /**
  * @brief reset the context to original state using original pointer to user_context and
  *  run the function. This assumes that the original user_context was constant 
@@ -169,7 +928,7 @@ void refresh_and_clear_context(context_blk_t *blk, void const *user_context);
  * @param blk 
  */
 void reset_and_run_context(context_blk_t *blk);
-
+#endif
 
 
 #endif // CONTEXT_H
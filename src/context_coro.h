@@ -0,0 +1,87 @@
+/**
+ * @file context_coro.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief resumable closures: a wrapper that yields returns from 
+ *  run_context() and carries on from the same place on the next run.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Build with CONTEXT_COROUTINE, which adds the resume point to
+ *  the header.  The wrapper is an ordinary context_func_t written between
+ *  CTX_CORO_BEGIN and CTX_CORO_END (stackless, after the protothreads of
+ *  A. Dunkels):
+ * 
+ *  void flash_erase_wrapper(context_blk_t *context)
+ *  {
+ *      erase_job_t *job = (erase_job_t*)context->user_context;
+ *      CTX_CORO_BEGIN(context);
+ *      for(job->sector = job->first; job->sector <= job->last; job->sector++)
+ *      {
+ *          flash_start_erase(job->sector);
+ *          CTX_AWAIT(context, flash_idle());   // give the dispatcher back until done
+ *      }
+ *      CTX_CORO_END(context);
+ *  }
+ * 
+ *  // dispatcher, time sliced
+ *  run_context(blk);
+ *  if(!context_coro_done(blk)) requeue(blk); else free_context_blk(blk);
+ * 
+ *  Local variables do not survive a yield, keep state in user_context or
+ *  the workspace.  The macros use switch/case, so a wrapper cannot yield
+ *  from inside a switch of its own, and must sit before line 65535 of its
+ *  file.  reset_context() starts it over.
+ */
+#ifndef CONTEXT_CORO_H
+#define CONTEXT_CORO_H
+#include "context.h"
+
+#ifndef CONTEXT_COROUTINE
+#error "context_coro.h needs the resume point of CONTEXT_COROUTINE in the header"
+#endif
+
+#define CTX_CORO_DONE 0xFFFFu   // resume point of a finished coroutine
+
+// the resume point is the 16 bit line number of the yield
+#define CTX_CORO_CHECK_LINE()                                               \
+    _Static_assert(__LINE__ < CTX_CORO_DONE, "coroutine yields past line 65534 do not fit the resume point")
+
+#define CTX_CORO_BEGIN(blk)                                                 \
+    switch((blk)->resume)                                                   \
+    {                                                                       \
+        case CTX_CORO_DONE:                                                 \
+            return;                                                         \
+        case 0:
+
+// return now, continue after this point on the next run
+#define CTX_YIELD(blk)                                                      \
+    do                                                                      \
+    {                                                                       \
+        CTX_CORO_CHECK_LINE();                                              \
+        (blk)->resume = __LINE__;                                           \
+        return;                                                             \
+        case __LINE__:;                                                     \
+    } while(0)
+
+// return on each run until cond holds, then carry on
+#define CTX_AWAIT(blk, cond)                                                \
+    do                                                                      \
+    {                                                                       \
+        CTX_CORO_CHECK_LINE();                                              \
+        (blk)->resume = __LINE__;                                           \
+        __attribute__((fallthrough));                                       \
+        case __LINE__:                                                      \
+        if(!(cond))                                                         \
+        {                                                                   \
+            return;                                                         \
+        }                                                                   \
+    } while(0)
+
+// finish, later runs do nothing
+#define CTX_CORO_END(blk)                                                   \
+    }                                                                       \
+    (blk)->resume = CTX_CORO_DONE
+
+#define context_coro_done(blk) ((blk)->resume == CTX_CORO_DONE)
+
+#endif // CONTEXT_CORO_H
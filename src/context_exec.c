@@ -0,0 +1,298 @@
+/**
+ * @file context_exec.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief work-stealing closure executor.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * 
+ */
+#include "context_exec.h"
+#ifdef CONTEXT_EXEC
+#include <sched.h>
+
+#if !defined(CONTEXT_LOCKFREE) && !defined(USE_MALLOC)
+#error "CONTEXT_EXEC frees closures from worker threads, build the pool with CONTEXT_LOCKFREE"
+#endif
+
+#define DEQUE_MASK (CTX_EXEC_DEQUE_DEPTH - 1)
+_Static_assert((CTX_EXEC_DEQUE_DEPTH & DEQUE_MASK) == 0, "CTX_EXEC_DEQUE_DEPTH must be a power of 2");
+
+#define FREE_AFTER ((uintptr_t)1)  // tag in the low bit of a queued blk pointer
+#define SPIN_ROUNDS 64             // idle scans before a worker parks
+
+static _Thread_local ctx_worker_t *current_worker;
+
+/**
+ * @brief owner check for a free deque slot, thieves only ever add room
+ */
+static int deque_room(ctx_worker_t *w)
+{
+    long b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+    return b - atomic_load_explicit(&w->top, memory_order_acquire) < CTX_EXEC_DEQUE_DEPTH;
+}
+
+/**
+ * @brief owner push onto the bottom of its deque
+ * 
+ * @return int 1 if pushed, 0 if the deque is full
+ */
+static int deque_push(ctx_worker_t *w, uintptr_t item)
+{
+    long b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&w->top, memory_order_acquire);
+    if(b - t >= CTX_EXEC_DEQUE_DEPTH)
+    {
+        return 0;
+    }
+    atomic_store_explicit(&w->deque[b & DEQUE_MASK], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * @brief owner pop from the bottom of its deque, newest first
+ * 
+ * @return uintptr_t 0 if empty
+ */
+static uintptr_t deque_pop(ctx_worker_t *w)
+{
+    long b = atomic_load_explicit(&w->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&w->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&w->top, memory_order_relaxed);
+    if(t > b)  // was empty
+    {
+        atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+    uintptr_t item = atomic_load_explicit(&w->deque[b & DEQUE_MASK], memory_order_relaxed);
+    if(t == b)  // last one, race the thieves for it
+    {
+        if(!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                    memory_order_seq_cst, memory_order_relaxed))
+        {
+            item = 0;
+        }
+        atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+/**
+ * @brief thief take from the top of another worker's deque, oldest first
+ * 
+ * @return uintptr_t 0 if empty or another thief won
+ */
+static uintptr_t deque_steal(ctx_worker_t *w)
+{
+    long t = atomic_load_explicit(&w->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&w->bottom, memory_order_acquire);
+    if(t >= b)
+    {
+        return 0;
+    }
+    uintptr_t item = atomic_load_explicit(&w->deque[t & DEQUE_MASK], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                memory_order_seq_cst, memory_order_relaxed))
+    {
+        return 0;
+    }
+    return item;
+}
+
+/**
+ * @brief find the next closure for a worker: own deque, then own inbox,
+ *  then the other workers' deques.
+ */
+static uintptr_t find_work(ctx_worker_t *w)
+{
+    uintptr_t item = deque_pop(w);
+    if(item)
+    {
+        return item;
+    }
+    // keep one from the inbox and spread the rest where thieves can see them
+    context_blk_t *blk = ctx_queue_pop(&w->inbox);
+    if(blk)
+    {
+        context_blk_t *more;
+        while(deque_room(w) && (more = ctx_queue_pop(&w->inbox)) != NULL)
+        {
+            deque_push(w, (uintptr_t)more);
+        }
+        return (uintptr_t)blk;
+    }
+    ctx_exec_t *exec = w->exec;
+    unsigned start = (w->seed = w->seed * 1103515245u + 12345u) >> 16;
+    for(unsigned i=0; i<exec->count; i++)
+    {
+        ctx_worker_t *victim = &exec->workers[(start + i) % exec->count];
+        if(victim != w && (item = deque_steal(victim)) != 0)
+        {
+            return item;
+        }
+    }
+    return 0;
+}
+
+static size_t completed(ctx_exec_t *exec)
+{
+    size_t done = 0;
+    for(unsigned i=0; i<exec->count; i++)
+    {
+        done += atomic_load_explicit(&exec->workers[i].completed, memory_order_acquire);
+    }
+    return done;
+}
+
+static void *worker_main(void *arg)
+{
+    ctx_worker_t *w = arg;
+    ctx_exec_t *exec = w->exec;
+    current_worker = w;
+    int idle = 0;
+    while(atomic_load_explicit(&exec->running, memory_order_acquire))
+    {
+        size_t epoch = atomic_load(&exec->queued);
+        uintptr_t item = find_work(w);
+        if(item)
+        {
+            context_blk_t *blk = (context_blk_t*)(item & ~FREE_AFTER);
+            if(item & FREE_AFTER)
+            {
+                run_context_and_free(blk);
+            }
+            else
+            {
+                run_context(blk);
+            }
+            atomic_fetch_add_explicit(&w->completed, 1, memory_order_release);
+            idle = 0;
+            continue;
+        }
+        if(++idle < SPIN_ROUNDS)
+        {
+            sched_yield();
+            continue;
+        }
+        // park until something new is queued
+        pthread_mutex_lock(&exec->lock);
+        atomic_fetch_add(&exec->sleepers, 1);
+        while(atomic_load(&exec->queued) == epoch && atomic_load(&exec->running))
+        {
+            pthread_cond_wait(&exec->wake, &exec->lock);
+        }
+        atomic_fetch_sub(&exec->sleepers, 1);
+        pthread_mutex_unlock(&exec->lock);
+        idle = 0;
+    }
+#ifdef CONTEXT_THREAD_CACHE
+    context_thread_cache_flush();  // the slots this worker freed go back to every thread
+#endif
+    current_worker = NULL;
+    return NULL;
+}
+
+static int submit(ctx_exec_t *exec, uintptr_t item)
+{
+    ctx_worker_t *w = current_worker;
+    int queued = 0;
+    atomic_fetch_add(&exec->submitted, 1);  // counted first so wait_idle cannot miss it
+    if(w && w->exec == exec)
+    {
+        queued = deque_push(w, item);
+    }
+    for(unsigned i=0; !queued && i<exec->count; i++)
+    {
+        unsigned n = atomic_fetch_add_explicit(&exec->next_inbox, 1, memory_order_relaxed);
+        queued = ctx_queue_push(&exec->workers[n % exec->count].inbox, (context_blk_t*)item);
+    }
+    if(!queued)
+    {
+        atomic_fetch_sub(&exec->submitted, 1);
+        return 0;
+    }
+    // only now can a worker find it, a worker that looked earlier sees a new epoch
+    atomic_fetch_add(&exec->queued, 1);
+    if(atomic_load(&exec->sleepers))
+    {
+        pthread_mutex_lock(&exec->lock);
+        pthread_cond_broadcast(&exec->wake);
+        pthread_mutex_unlock(&exec->lock);
+    }
+    return 1;
+}
+
+int ctx_exec_start(ctx_exec_t *exec, unsigned workers)
+{
+    if(workers == 0 || workers > CTX_EXEC_MAX_WORKERS)
+    {
+        return 0;
+    }
+    exec->count = workers;
+    atomic_init(&exec->running, 1);
+    atomic_init(&exec->submitted, 0);
+    atomic_init(&exec->queued, 0);
+    atomic_init(&exec->next_inbox, 0);
+    atomic_init(&exec->sleepers, 0);
+    pthread_mutex_init(&exec->lock, NULL);
+    pthread_cond_init(&exec->wake, NULL);
+    for(unsigned i=0; i<workers; i++)
+    {
+        ctx_worker_t *w = &exec->workers[i];
+        atomic_init(&w->top, 0);
+        atomic_init(&w->bottom, 0);
+        atomic_init(&w->completed, 0);
+        ctx_queue_init(&w->inbox, CTX_QUEUE_MPSC);
+        w->exec = exec;
+        w->seed = i + 1;
+    }
+    for(unsigned i=0; i<workers; i++)
+    {
+        if(pthread_create(&exec->workers[i].thread, NULL, worker_main, &exec->workers[i]) != 0)
+        {
+            exec->count = i;
+            ctx_exec_stop(exec);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int ctx_exec_submit(ctx_exec_t *exec, context_blk_t *blk)
+{
+    return submit(exec, (uintptr_t)blk);
+}
+
+int ctx_exec_submit_and_free(ctx_exec_t *exec, context_blk_t *blk)
+{
+    return submit(exec, (uintptr_t)blk | FREE_AFTER);
+}
+
+void ctx_exec_wait_idle(ctx_exec_t *exec)
+{
+    while(completed(exec) != atomic_load(&exec->submitted))
+    {
+        sched_yield();
+    }
+}
+
+void ctx_exec_stop(ctx_exec_t *exec)
+{
+    ctx_exec_wait_idle(exec);
+    pthread_mutex_lock(&exec->lock);
+    atomic_store(&exec->running, 0);
+    pthread_cond_broadcast(&exec->wake);
+    pthread_mutex_unlock(&exec->lock);
+    for(unsigned i=0; i<exec->count; i++)
+    {
+        pthread_join(exec->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&exec->wake);
+    pthread_mutex_destroy(&exec->lock);
+}
+
+#endif // CONTEXT_EXEC
@@ -0,0 +1,112 @@
+/**
+ * @file context_exec.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief work-stealing thread pool that runs closures.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Only built with CONTEXT_EXEC defined (POSIX threads), so bare
+ *  metal targets keep using context.c on its own.  Worker threads share the
+ *  pool, so the pool must be built with CONTEXT_LOCKFREE or USE_MALLOC.
+ * 
+ *  Each worker owns a Chase-Lev deque.  Closures submitted from outside the
+ *  pool land in a worker's inbox (a CTX_QUEUE_MPSC ctx_queue_t) and are
+ *  moved onto its deque; closures submitted from inside a running closure go
+ *  straight onto the deque of the worker running it.  A worker with nothing
+ *  left steals the oldest closure from another worker's deque.
+ * 
+ *  static ctx_exec_t exec;
+ *  ctx_exec_start(&exec, 4);
+ *  ctx_exec_submit_and_free(&exec, package_context(my_found_function_wrapper, &original, sizeof original, 64));
+ *  ctx_exec_wait_idle(&exec);
+ *  ctx_exec_stop(&exec);
+ */
+#ifndef CONTEXT_EXEC_H
+#define CONTEXT_EXEC_H
+#ifdef CONTEXT_EXEC
+#include <pthread.h>
+#include <stdatomic.h>
+#include "context.h"
+#include "context_queue.h"
+
+#ifndef CTX_EXEC_MAX_WORKERS
+#define CTX_EXEC_MAX_WORKERS 16     // upper bound on worker threads
+#endif
+
+#ifndef CTX_EXEC_DEQUE_DEPTH
+#define CTX_EXEC_DEQUE_DEPTH 1024   // closures per worker deque, power of 2
+#endif
+
+typedef struct ctx_exec_t ctx_exec_t;
+
+typedef struct ctx_worker_t
+{
+    _Alignas(CONTEXT_CACHE_LINE) atomic_long top;  // thieves take from here
+    _Alignas(CONTEXT_CACHE_LINE) atomic_long bottom;  // owner pushes and pops here
+    atomic_size_t completed;            // closures this worker has run
+    _Alignas(CONTEXT_CACHE_LINE) _Atomic(uintptr_t) deque[CTX_EXEC_DEQUE_DEPTH];
+    ctx_queue_t inbox;                  // submissions from outside the pool
+    ctx_exec_t *exec;
+    pthread_t thread;
+    uint32_t seed;                      // victim selection
+} ctx_worker_t;
+
+struct ctx_exec_t
+{
+    ctx_worker_t workers[CTX_EXEC_MAX_WORKERS];
+    unsigned count;                     // workers started
+    atomic_int running;
+    _Alignas(CONTEXT_CACHE_LINE) atomic_size_t submitted;  // counted for ctx_exec_wait_idle()
+    atomic_size_t queued;               // wake up epoch, bumped once a closure is visible
+    atomic_uint next_inbox;             // round robin for outside submissions
+    atomic_int sleepers;
+    pthread_mutex_t lock;               // parks idle workers
+    pthread_cond_t wake;
+};
+
+/**
+ * @brief start the worker threads
+ * 
+ * @param exec executor, usually static, it is large
+ * @param workers number of threads, 1 to CTX_EXEC_MAX_WORKERS
+ * @return int 1 if started, 0 on error (no threads left running)
+ */
+int ctx_exec_start(ctx_exec_t *exec, unsigned workers);
+
+/**
+ * @brief queue a closure to be run with run_context(), the caller keeps
+ *  ownership and must not free it until it has run.
+ * 
+ * @param exec executor
+ * @param blk closure
+ * @return int 1 if queued, 0 if every inbox was full
+ */
+int ctx_exec_submit(ctx_exec_t *exec, context_blk_t *blk);
+
+/**
+ * @brief queue a closure to be run with run_context_and_free(), the 
+ *  executor takes ownership.
+ * 
+ * @param exec executor
+ * @param blk closure
+ * @return int 1 if queued, 0 if every inbox was full (caller still owns blk)
+ */
+int ctx_exec_submit_and_free(ctx_exec_t *exec, context_blk_t *blk);
+
+/**
+ * @brief wait until every closure submitted so far has run.  Not for use
+ *  from inside a closure.
+ * 
+ * @param exec executor
+ */
+void ctx_exec_wait_idle(ctx_exec_t *exec);
+
+/**
+ * @brief finish the queued work, stop and join the worker threads
+ * 
+ * @param exec executor
+ */
+void ctx_exec_stop(ctx_exec_t *exec);
+
+#endif // CONTEXT_EXEC
+#endif // CONTEXT_EXEC_H
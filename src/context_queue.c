@@ -0,0 +1,179 @@
+/**
+ * @file context_queue.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief bounded lock-free closure queue.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * 
+ */
+#include "context_queue.h"
+#include <stdint.h>
+
+#define QUEUE_MASK (CTX_QUEUE_DEPTH - 1)
+_Static_assert((CTX_QUEUE_DEPTH & QUEUE_MASK) == 0, "CTX_QUEUE_DEPTH must be a power of 2");
+
+void ctx_queue_init(ctx_queue_t *q, ctx_queue_mode_t mode)
+{
+    q->mode = mode;
+    for(size_t i=0; i<CTX_QUEUE_DEPTH; i++)
+    {
+        atomic_init(&q->slots[i].seq, i);
+        q->slots[i].blk = NULL;
+    }
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+int ctx_queue_push(ctx_queue_t *q, context_blk_t *blk)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    ctx_queue_slot_t *slot;
+    for(;;)
+    {
+        slot = &q->slots[pos & QUEUE_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if(dif < 0)  // consumer has not freed the slot yet
+        {
+            return 0;
+        }
+        if(q->mode == CTX_QUEUE_SPSC)  // no other producer to race
+        {
+            if(dif > 0)
+            {
+                return 0;
+            }
+            atomic_store_explicit(&q->tail, pos + 1, memory_order_relaxed);
+            break;
+        }
+        if(dif == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+            {
+                break;  // slot is ours
+            }
+        }
+        else  // another producer took this position
+        {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    slot->blk = blk;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);  // publish
+    return 1;
+}
+
+context_blk_t *ctx_queue_pop(ctx_queue_t *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    ctx_queue_slot_t *slot = &q->slots[pos & QUEUE_MASK];
+    if(atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+    {
+        return NULL;  // empty, or the producer has not published yet
+    }
+    context_blk_t *blk = slot->blk;
+    // open the slot for the push one lap ahead
+    atomic_store_explicit(&slot->seq, pos + CTX_QUEUE_DEPTH, memory_order_release);
+    atomic_store_explicit(&q->head, pos + 1, memory_order_relaxed);
+    return blk;
+}
+
+size_t ctx_queue_drain(ctx_queue_t *q, context_func_t run)
+{
+    size_t count = 0;
+    context_blk_t *blk;
+    while(count < CTX_QUEUE_DEPTH && (blk = ctx_queue_pop(q)) != NULL)
+    {
+        run(blk);
+        count++;
+    }
+    return count;
+}
+
+_Static_assert(CTX_PRIO_LEVELS <= 16, "CTX_PRIO() has 4 bits of level");
+
+#define TOP_LEVEL(bits) (31 - __builtin_clz(bits))
+
+void ctx_prio_queue_init(ctx_prio_queue_t *q, ctx_queue_mode_t mode, unsigned starve_limit)
+{
+    for(int i=0; i<CTX_PRIO_LEVELS; i++)
+    {
+        ctx_queue_init(&q->levels[i], mode);
+    }
+    atomic_init(&q->ready, 0);
+    q->starve_limit = starve_limit;
+    q->streak = 0;
+    q->guard = CTX_PRIO_LEVELS;
+}
+
+int ctx_prio_queue_push(ctx_prio_queue_t *q, context_blk_t *blk)
+{
+    unsigned level = context_priority(blk);
+    level = level < CTX_PRIO_LEVELS ? level : CTX_PRIO_LEVELS - 1;
+    if(!ctx_queue_push(&q->levels[level], blk))
+    {
+        return 0;
+    }
+    atomic_fetch_or_explicit(&q->ready, 1u << level, memory_order_release);  // after the publish
+    return 1;
+}
+
+/**
+ * @brief pop one level, dropping its ready bit if it turns out empty
+ */
+static context_blk_t *pop_level(ctx_prio_queue_t *q, int level)
+{
+    context_blk_t *blk = ctx_queue_pop(&q->levels[level]);
+    if(!blk)
+    {
+        // clear then look again, a push between the two sets the bit back
+        atomic_fetch_and_explicit(&q->ready, ~(1u << level), memory_order_acq_rel);
+        blk = ctx_queue_pop(&q->levels[level]);
+        if(blk)
+        {
+            atomic_fetch_or_explicit(&q->ready, 1u << level, memory_order_relaxed);
+        }
+    }
+    return blk;
+}
+
+context_blk_t *ctx_prio_queue_pop(ctx_prio_queue_t *q)
+{
+    unsigned ready;
+    while((ready = atomic_load_explicit(&q->ready, memory_order_acquire)) != 0)
+    {
+        int level = TOP_LEVEL(ready);
+        unsigned below = ready & ((1u << level) - 1);  // lower levels waiting
+        if(!below)
+        {
+            q->streak = 0;
+        }
+        else if(q->starve_limit && ++q->streak > q->starve_limit)
+        {
+            unsigned under = below & ((1u << q->guard) - 1);  // below the level served last time
+            level = TOP_LEVEL(under ? under : below);
+            q->guard = (unsigned)level;
+            q->streak = 0;
+        }
+        context_blk_t *blk = pop_level(q, level);
+        if(blk)
+        {
+            return blk;
+        }
+    }
+    return NULL;
+}
+
+size_t ctx_prio_queue_drain(ctx_prio_queue_t *q, context_func_t run)
+{
+    size_t count = 0;
+    context_blk_t *blk;
+    while(count < CTX_QUEUE_DEPTH && (blk = ctx_prio_queue_pop(q)) != NULL)
+    {
+        run(blk);
+        count++;
+    }
+    return count;
+}
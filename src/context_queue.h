@@ -0,0 +1,154 @@
+/**
+ * @file context_queue.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief bounded lock-free ring of closures for handing context_blk_t 
+ *  ownership from producers to one consumer.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Only the pointer travels through the ring, the closure itself is
+ *  never copied.  Whoever pushes a blk gives it up; whoever pops it owns it
+ *  and is responsible for running and freeing it.
+ * 
+ *  ctx_queue_t q;
+ *  ctx_queue_init(&q, CTX_QUEUE_MPSC);
+ * 
+ *  // any producer, interrupt or other core
+ *  if(!ctx_queue_push(&q, package_context(my_found_function_wrapper, &original, sizeof original, 64)))
+ *  {
+ *      // queue full
+ *  }
+ * 
+ *  // the one consumer
+ *  ctx_queue_drain(&q, run_context_and_free);
+ * 
+ *  Each slot carries a sequence count (bounded queue after D. Vyukov) so
+ *  producers and the consumer only meet on the slot they both touch.  The
+ *  producer and consumer indexes sit on their own cache lines.
+ */
+#ifndef CONTEXT_QUEUE_H
+#define CONTEXT_QUEUE_H
+#include <stdatomic.h>
+#include "context.h"
+
+#ifndef CTX_QUEUE_DEPTH
+#define CTX_QUEUE_DEPTH 32      // slots per queue, must be a power of 2
+#endif
+
+typedef enum ctx_queue_mode_t
+{
+    CTX_QUEUE_SPSC,     // one producer, one consumer
+    CTX_QUEUE_MPSC,     // any number of producers, one consumer
+} ctx_queue_mode_t;
+
+typedef struct ctx_queue_slot_t
+{
+    atomic_size_t seq;  // ring position the slot is ready for
+    context_blk_t *blk;
+} ctx_queue_slot_t;
+
+typedef struct ctx_queue_t
+{
+    _Alignas(CONTEXT_CACHE_LINE) atomic_size_t tail;  // next position to push
+    ctx_queue_mode_t mode;
+    _Alignas(CONTEXT_CACHE_LINE) atomic_size_t head;  // next position to pop
+    _Alignas(CONTEXT_CACHE_LINE) ctx_queue_slot_t slots[CTX_QUEUE_DEPTH];
+} ctx_queue_t;
+
+/**
+ * @brief prepare an empty queue
+ * 
+ * @param q pointer to the queue
+ * @param mode CTX_QUEUE_SPSC or CTX_QUEUE_MPSC
+ */
+void ctx_queue_init(ctx_queue_t *q, ctx_queue_mode_t mode);
+
+/**
+ * @brief hand a closure to the consumer.
+ * 
+ * @param q pointer to the queue
+ * @param blk closure, owned by the queue on success
+ * @return int 1 if queued, 0 if the queue is full (caller still owns blk)
+ */
+int ctx_queue_push(ctx_queue_t *q, context_blk_t *blk);
+
+/**
+ * @brief take the oldest closure, consumer only.
+ * 
+ * @param q pointer to the queue
+ * @return context_blk_t* NULL if the queue is empty
+ */
+context_blk_t *ctx_queue_pop(ctx_queue_t *q);
+
+/**
+ * @brief pop and hand each closure to run, typically run_context_and_free.
+ *  At most CTX_QUEUE_DEPTH closures are taken per call so a busy producer
+ *  cannot hold the consumer forever.
+ * 
+ * @param q pointer to the queue
+ * @param run called with each closure popped
+ * @return size_t number of closures run
+ */
+size_t ctx_queue_drain(ctx_queue_t *q, context_func_t run);
+
+/*
+    A priority queue is one ring per level and a bitmap of the levels that
+    may hold closures, so the most urgent closure is found with one count
+    of leading zeros however many levels are idle.  Each closure goes to 
+    the level of context_priority(blk).  With a starvation guard, after
+    starve_limit closures in a row have been taken over waiting lower
+    levels, the next one comes from a lower level, taking the lower levels
+    in turn.  A closure is then never passed over more than about 
+    starve_limit * CTX_PRIO_LEVELS times.
+*/
+#ifndef CTX_PRIO_LEVELS
+#define CTX_PRIO_LEVELS 8       // levels 0 (lowest) to CTX_PRIO_LEVELS-1
+#endif
+
+typedef struct ctx_prio_queue_t
+{
+    ctx_queue_t levels[CTX_PRIO_LEVELS];
+    _Alignas(CONTEXT_CACHE_LINE) atomic_uint ready;  // bit per level that may hold closures
+    unsigned starve_limit;      // 0 for strict priority
+    unsigned streak;            // taken in a row while lower levels waited, consumer only
+    unsigned guard;             // level the guard served last, consumer only
+} ctx_prio_queue_t;
+
+/**
+ * @brief prepare an empty priority queue
+ * 
+ * @param q pointer to the queue
+ * @param mode CTX_QUEUE_SPSC or CTX_QUEUE_MPSC
+ * @param starve_limit closures taken over waiting lower levels before one
+ *  of them is served, 0 for strict priority
+ */
+void ctx_prio_queue_init(ctx_prio_queue_t *q, ctx_queue_mode_t mode, unsigned starve_limit);
+
+/**
+ * @brief hand a closure to the consumer at its priority
+ * 
+ * @param q pointer to the queue
+ * @param blk closure, owned by the queue on success
+ * @return int 1 if queued, 0 if its level is full (caller still owns blk)
+ */
+int ctx_prio_queue_push(ctx_prio_queue_t *q, context_blk_t *blk);
+
+/**
+ * @brief take the most urgent closure, consumer only
+ * 
+ * @param q pointer to the queue
+ * @return context_blk_t* NULL if the queue is empty
+ */
+context_blk_t *ctx_prio_queue_pop(ctx_prio_queue_t *q);
+
+/**
+ * @brief pop and run closures most urgent first.  At most CTX_QUEUE_DEPTH
+ *  closures are taken per call.
+ * 
+ * @param q pointer to the queue
+ * @param run called with each closure popped
+ * @return size_t number of closures run
+ */
+size_t ctx_prio_queue_drain(ctx_prio_queue_t *q, context_func_t run);
+
+#endif // CONTEXT_QUEUE_H
@@ -0,0 +1,129 @@
+/**
+ * @file context_shm.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief closure pool over a shm_open() region shared by processes.
+ * @date 2026-10-14
+ *
+ * @copyright Copyright LightGear (2024)
+ *
+ */
+#include "context_shm.h"
+#ifdef CONTEXT_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x43545853u   // "CTXS", written last by the creator
+
+// start of the region, the pool memory follows on the next cache line
+typedef struct shm_header_t
+{
+    uint32_t magic;
+    uint32_t header_size;       // sizeof(context_blk_t), the same build on every side
+    uint64_t blk_size;
+    uint64_t count;
+    uint64_t base;              // address the creator mapped the region at
+    uint16_t id;
+} shm_header_t;
+
+#define SHM_POOL_OFFSET ((sizeof(shm_header_t) + CONTEXT_CACHE_LINE - 1) / CONTEXT_CACHE_LINE * CONTEXT_CACHE_LINE)
+#define SHM_BYTES(blk_size, count) (SHM_POOL_OFFSET + CONTEXT_POOL_MEMORY(blk_size, count))
+
+/**
+ * @brief does a published header describe the pool asked for
+ */
+static int shm_matches(const shm_header_t *hdr, size_t blk_size, size_t count, uint16_t id)
+{
+    return hdr->header_size == sizeof(context_blk_t) && hdr->blk_size == blk_size &&
+           hdr->count == count && hdr->id == id;
+}
+
+int context_shm_pool_open(context_pool_t *pool, const char *name, size_t blk_size, size_t count, uint16_t id)
+{
+    const size_t bytes = SHM_BYTES(blk_size, count);
+    int creator = 1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0)
+    {
+        creator = 0;
+        fd = shm_open(name, O_RDWR, 0600);
+        if(fd < 0)
+        {
+            return 0;
+        }
+    }
+    void *hint = NULL;
+    if(creator)
+    {
+        // new pages read as zero, an empty bitmap
+        if(ftruncate(fd, (off_t)bytes) != 0)
+        {
+            close(fd);
+            shm_unlink(name);
+            return 0;
+        }
+    }
+    else
+    {
+        shm_header_t hdr;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < bytes ||
+           pread(fd, &hdr, sizeof hdr, 0) != (ssize_t)sizeof hdr || hdr.magic != SHM_MAGIC)
+        {
+            close(fd);
+            return 0;   // not laid out yet, or not a pool
+        }
+        hint = (void*)(uintptr_t)hdr.base;
+    }
+    uint8_t *map = mmap(hint, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        if(creator)
+        {
+            shm_unlink(name);
+        }
+        return 0;
+    }
+    shm_header_t *hdr = (shm_header_t*)map;
+    if(creator)
+    {
+        hdr->header_size = sizeof(context_blk_t);
+        hdr->blk_size = blk_size;
+        hdr->count = count;
+        hdr->base = (uintptr_t)map;
+        hdr->id = id;
+        __atomic_store_n(&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    else if(!shm_matches(hdr, blk_size, count, id)
+#ifndef CONTEXT_COMPACT_HEADER
+            || map != hint  // workspace pointers in the blocks are absolute
+#endif
+           )
+    {
+        munmap(map, bytes);
+        return 0;
+    }
+    if(!context_pool_attach(pool, map + SHM_POOL_OFFSET, blk_size, count, id))
+    {
+        munmap(map, bytes);
+        if(creator)
+        {
+            shm_unlink(name);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+void context_shm_pool_close(context_pool_t *pool, const char *unlink_name)
+{
+    context_pool_deinit(pool);
+    munmap((uint8_t*)pool->in_use - SHM_POOL_OFFSET, SHM_BYTES(pool->blk_size, pool->count));
+    if(unlink_name)
+    {
+        shm_unlink(unlink_name);
+    }
+}
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file context_shm.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief closure pool in POSIX shared memory, built only with CONTEXT_SHM.
+ * @date 2026-10-14
+ *
+ * @copyright Copyright LightGear (2024)
+ * @details Several processes open the same named pool and package straight
+ *  into it, handing the executor an offset instead of copying the closure
+ *  through a pipe or socket:
+ *
+ *  // every process, the id is agreed between them
+ *  static context_pool_t work_pool;
+ *  context_shm_pool_open(&work_pool, "/work", 256, 1024, 3);
+ *  // producer
+ *  context_blk_t *blk = package_context_in(&work_pool, job_wrapper, &job, sizeof job, 0);
+ *  write(to_executor, &(size_t){context_pool_offset(&work_pool, blk)}, sizeof(size_t));
+ *  // executor
+ *  read(from_producers, &offset, sizeof offset);
+ *  run_context_and_free(context_pool_at(&work_pool, offset));
+ *
+ *  The first process to open the name creates the region, later ones
+ *  attach to it at the address it was created at, so the workspace pointer
+ *  of a closure holds everywhere.  target_func only holds between
+ *  processes running the same executable at the same load address (forked
+ *  from one parent, or built without PIE); otherwise send the closure's
+ *  context_export() descriptor (CONTEXT_WIRE) with the offset and
+ *  context_import() it on arrival.  original_context is an address in
+ *  the producer, reset_context() and the reset_and_ functions are only
+ *  for closures this process packaged.  Pool statistics count this process
+ *  only.  Needs CONTEXT_LOCKFREE, the bitmap is updated by every process.
+ */
+#ifndef CONTEXT_SHM_H
+#define CONTEXT_SHM_H
+#include "context.h"
+
+#if defined(CONTEXT_SHM) && !defined(CONTEXT_LOCKFREE)
+#error "CONTEXT_SHM shares the pool bitmap between processes, it needs CONTEXT_LOCKFREE"
+#endif
+
+/**
+ * @brief create or attach to a named shared pool and register it
+ *
+ * @param pool pool object of this process, must outlive its use
+ * @param name shared memory object name, "/something"
+ * @param blk_size bytes per block, a multiple of 8 larger than the header
+ * @param count number of blocks
+ * @param id pool id every process uses for it, 1 to CONTEXT_MAX_POOLS-1
+ * @return int 1 on success, 0 if the object cannot be made or mapped, it
+ *  was made with another geometry or id, its creator has not finished
+ *  laying it out (try again), or the id is taken in this process
+ */
+int context_shm_pool_open(context_pool_t *pool, const char *name, size_t blk_size, size_t count, uint16_t id);
+
+/**
+ * @brief unregister and unmap a shared pool.  Closures this process still
+ *  holds stay allocated for the others.
+ *
+ * @param pool the pool
+ * @param unlink_name name to remove so no further process can open it,
+ *  NULL to leave it
+ */
+void context_shm_pool_close(context_pool_t *pool, const char *unlink_name);
+
+#endif // CONTEXT_SHM_H
@@ -0,0 +1,195 @@
+/**
+ * @file context_timer.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief hierarchical timer wheel.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * 
+ */
+#include "context_timer.h"
+#include <string.h>
+
+#define SLOT_MASK (CTX_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * CTX_WHEEL_BITS)
+#define WHEEL_SPAN (((uint64_t)1 << LEVEL_SHIFT(CTX_WHEEL_LEVELS)) - 1)  // furthest a timer can be placed
+_Static_assert(LEVEL_SHIFT(CTX_WHEEL_LEVELS) <= 32, "wheel wider than the tick counter");
+#define TIMER_DUE 0x80000000u  // collected by this tick, a start or cancel takes it away
+_Static_assert((CTX_TIMER_FREE & TIMER_DUE) == 0, "timer flags overlap");
+
+/**
+ * @brief link a timer into the slot its expiry falls in
+ */
+static void place(ctx_wheel_t *wheel, ctx_timer_t *timer)
+{
+    uint32_t delta = timer->expires - wheel->now;
+    uint32_t at = timer->expires;
+    if(delta > WHEEL_SPAN)  // beyond the top level, park at its far end and look again then
+    {
+        at = wheel->now + (uint32_t)WHEEL_SPAN;
+        delta = (uint32_t)WHEEL_SPAN;
+    }
+    int level = 0;
+    while(level < CTX_WHEEL_LEVELS - 1 && delta >> LEVEL_SHIFT(level + 1))
+    {
+        level++;
+    }
+    ctx_timer_t **head = &wheel->slots[level][(at >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    timer->next = *head;
+    if(timer->next)
+    {
+        timer->next->link = &timer->next;
+    }
+    timer->link = head;
+    *head = timer;
+}
+
+static void unlink_timer(ctx_timer_t *timer)
+{
+    *timer->link = timer->next;
+    if(timer->next)
+    {
+        timer->next->link = timer->link;
+    }
+    timer->link = NULL;
+}
+
+void ctx_wheel_init(ctx_wheel_t *wheel, uint32_t now)
+{
+    memset(wheel->slots, 0, sizeof wheel->slots);
+    wheel->now = now;
+}
+
+void ctx_timer_init(ctx_timer_t *timer)
+{
+    *timer = (ctx_timer_t)CTX_TIMER_INIT;
+}
+
+void ctx_timer_start(ctx_wheel_t *wheel, ctx_timer_t *timer, context_blk_t *blk, uint32_t delay, uint32_t period, unsigned flags)
+{
+    if(timer->link)
+    {
+        unlink_timer(timer);
+    }
+    timer->blk = blk;
+    timer->expires = wheel->now + (delay ? delay : 1);
+    timer->period = period;
+    timer->flags = flags;
+    place(wheel, timer);
+}
+
+void ctx_timer_cancel(ctx_wheel_t *wheel, ctx_timer_t *timer)
+{
+    (void)wheel;
+    if(timer->link)
+    {
+        unlink_timer(timer);
+    }
+    timer->period = 0;  // also stops a timer whose closure is running now
+    timer->flags &= ~(CTX_TIMER_FREE | TIMER_DUE);  // or one due later in the same tick
+}
+
+int ctx_timer_pending(const ctx_timer_t *timer)
+{
+    return timer->link != NULL;
+}
+
+/**
+ * @brief move the timers of one slot down to the levels below
+ */
+static void cascade(ctx_wheel_t *wheel, int level)
+{
+    ctx_timer_t **head = &wheel->slots[level][(wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    ctx_timer_t *timer = *head;
+    *head = NULL;
+    while(timer)
+    {
+        ctx_timer_t *next = timer->next;
+        place(wheel, timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief run a batch of due timers one by one, then reschedule or free each.
+ *  A closure may cancel or restart a timer later in the batch, so each is
+ *  checked just before it runs.
+ */
+static size_t dispatch(ctx_wheel_t *wheel, ctx_timer_t **due, size_t n)
+{
+    context_blk_t *frees[CTX_TIMER_BATCH];
+    size_t n_free = 0;
+    size_t ran = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        if(i + 1 < n)
+        {
+            __builtin_prefetch(due[i + 1]->blk);
+        }
+        if(due[i]->flags & TIMER_DUE)
+        {
+            run_context(due[i]->blk);
+            ran++;
+        }
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        ctx_timer_t *timer = due[i];
+        if(!(timer->flags & TIMER_DUE))
+        {
+            continue;   // cancelled or restarted by a closure in the batch
+        }
+        timer->flags &= ~TIMER_DUE;
+        if(timer->period)
+        {
+            timer->expires += timer->period;  // no drift from late ticks
+            if((int32_t)(timer->expires - wheel->now) <= 0)
+            {
+                timer->expires = wheel->now + 1;  // overran, run at the next tick
+            }
+            place(wheel, timer);
+        }
+        else if(timer->flags & CTX_TIMER_FREE)
+        {
+            frees[n_free++] = timer->blk;
+        }
+    }
+    free_context_batch(frees, n_free);
+    return ran;
+}
+
+size_t ctx_timer_tick(ctx_wheel_t *wheel)
+{
+    wheel->now++;
+    for(int level=1; level<CTX_WHEEL_LEVELS; level++)  // reached the next slot of the level above
+    {
+        if(wheel->now & (((uint32_t)1 << LEVEL_SHIFT(level)) - 1))
+        {
+            break;
+        }
+        cascade(wheel, level);
+    }
+    ctx_timer_t **head = &wheel->slots[0][wheel->now & SLOT_MASK];
+    ctx_timer_t *due[CTX_TIMER_BATCH];
+    size_t count = 0;
+    while(*head)
+    {
+        size_t n = 0;
+        while(*head && n < CTX_TIMER_BATCH)
+        {
+            ctx_timer_t *timer = *head;
+            unlink_timer(timer);
+            if(timer->expires == wheel->now)
+            {
+                timer->flags |= TIMER_DUE;
+                due[n++] = timer;
+            }
+            else
+            {
+                place(wheel, timer);  // parked beyond the top level, not due yet
+            }
+        }
+        count += dispatch(wheel, due, n);
+    }
+    return count;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file context_timer.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief hierarchical timer wheel for running closures later or
+ *  periodically.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Time is counted in ticks of whatever period the application
+ *  calls ctx_timer_tick() at.  Each timer is a ctx_timer_t the caller
+ *  owns, linked into the wheel while pending, so starting and cancelling
+ *  are O(1) and the wheel never allocates.  A timer starts out idle from
+ *  CTX_TIMER_INIT or ctx_timer_init() (static ones already are).
+ * 
+ *  static ctx_wheel_t wheel;
+ *  static ctx_timer_t blink_timer, timeout_timer;
+ *  ctx_wheel_init(&wheel, 0);
+ *  ctx_timer_start(&wheel, &blink_timer, blink, 100, 100, 0);   // every 100 ticks
+ *  ctx_timer_start(&wheel, &timeout_timer, package_context(on_timeout, &req, sizeof req, 0),
+ *                  5, 0, CTX_TIMER_FREE);                        // once, in 5 ticks
+ * 
+ *  // 1 ms interrupt or thread
+ *  ctx_timer_tick(&wheel);
+ * 
+ *  Level 0 holds the next CTX_WHEEL_SLOTS ticks one slot per tick, each
+ *  level above covers CTX_WHEEL_SLOTS times the span of the one below and
+ *  is cascaded down as time reaches it.  Due timers are collected 
+ *  CTX_TIMER_BATCH at a time and their closures run one after another, 
+ *  each checked just before it runs so a closure may cancel or restart a
+ *  timer due on the same tick.  The wheel belongs to one thread: start,
+ *  cancel and tick from that thread (closures run by the tick may start 
+ *  and cancel timers).
+ */
+#ifndef CONTEXT_TIMER_H
+#define CONTEXT_TIMER_H
+#include "context.h"
+
+#ifndef CTX_WHEEL_BITS
+#define CTX_WHEEL_BITS 6                        // slots per level as a power of 2
+#endif
+#define CTX_WHEEL_SLOTS (1u << CTX_WHEEL_BITS)
+#ifndef CTX_WHEEL_LEVELS
+#define CTX_WHEEL_LEVELS 4                      // 2^24 ticks before timers are re-cascaded
+#endif
+#ifndef CTX_TIMER_BATCH
+#define CTX_TIMER_BATCH 32                      // due timers collected per pass
+#endif
+
+#define CTX_TIMER_FREE 1u   // free a one-shot closure once it has run, the top bit is the wheel's
+
+#define CTX_TIMER_INIT {0}  // an idle timer, ctx_timer_t timer = CTX_TIMER_INIT;
+
+typedef struct ctx_timer_t ctx_timer_t;
+struct ctx_timer_t
+{
+    ctx_timer_t *next;
+    ctx_timer_t **link;     // the pointer to this timer, NULL when not in the wheel
+    context_blk_t *blk;
+    uint32_t expires;       // tick to run at
+    uint32_t period;        // ticks between runs, 0 for one-shot
+    unsigned flags;
+};
+
+typedef struct ctx_wheel_t
+{
+    uint32_t now;           // current tick
+    ctx_timer_t *slots[CTX_WHEEL_LEVELS][CTX_WHEEL_SLOTS];
+} ctx_wheel_t;
+
+/**
+ * @brief prepare an empty wheel
+ * 
+ * @param wheel the wheel
+ * @param now starting tick
+ */
+void ctx_wheel_init(ctx_wheel_t *wheel, uint32_t now);
+
+/**
+ * @brief make a timer idle before its first start, the same as
+ *  CTX_TIMER_INIT for one that is not declared with it
+ * 
+ * @param timer timer node, not pending
+ */
+void ctx_timer_init(ctx_timer_t *timer);
+
+/**
+ * @brief schedule a closure, restarting the timer if it was pending
+ * 
+ * @param wheel the wheel
+ * @param timer timer node, must stay valid while pending, initialised
+ *  (ctx_timer_init() or CTX_TIMER_INIT) before the first start
+ * @param blk closure to run
+ * @param delay ticks from now to the first run, 0 runs at the next tick
+ * @param period ticks between later runs, 0 for a one-shot
+ * @param flags CTX_TIMER_FREE or 0
+ */
+void ctx_timer_start(ctx_wheel_t *wheel, ctx_timer_t *timer, context_blk_t *blk, uint32_t delay, uint32_t period, unsigned flags);
+
+/**
+ * @brief stop a timer.  The closure is not run and not freed, it belongs to
+ *  the caller again, even when the timer is due on the tick being run.  A
+ *  periodic timer cancelled from its own closure is not rescheduled.
+ * 
+ * @param wheel the wheel
+ * @param timer timer node
+ */
+void ctx_timer_cancel(ctx_wheel_t *wheel, ctx_timer_t *timer);
+
+/**
+ * @brief whether a timer is waiting to run
+ * 
+ * @param timer timer node
+ * @return int 1 if pending
+ */
+int ctx_timer_pending(const ctx_timer_t *timer);
+
+/**
+ * @brief advance the wheel one tick and run every closure due
+ * 
+ * @param wheel the wheel
+ * @return size_t number of closures run
+ */
+size_t ctx_timer_tick(ctx_wheel_t *wheel);
+
+#endif // CONTEXT_TIMER_H
@@ -0,0 +1,138 @@
+/**
+ * @file context_trace.c
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief ring of run_context() timings.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * 
+ */
+#include "context_trace.h"
+#ifdef CONTEXT_TRACE
+#include <inttypes.h>
+
+#define TRACE_MASK (CTX_TRACE_DEPTH - 1)
+_Static_assert((CTX_TRACE_DEPTH & TRACE_MASK) == 0, "CTX_TRACE_DEPTH must be a power of 2");
+
+typedef struct trace_slot_t
+{
+    atomic_size_t seq;  // position + 1 once written, 0 while being written
+    ctx_trace_record_t record;
+} trace_slot_t;
+
+static _Atomic(ctx_trace_clock_t) trace_clock;
+static atomic_size_t trace_head;    // next position to write
+static trace_slot_t trace_ring[CTX_TRACE_DEPTH];
+
+void ctx_trace_set_clock(ctx_trace_clock_t clock)
+{
+    atomic_store(&trace_clock, clock);
+}
+
+void ctx_trace_reset(void)
+{
+    for(size_t i=0; i<CTX_TRACE_DEPTH; i++)
+    {
+        atomic_store_explicit(&trace_ring[i].seq, 0, memory_order_relaxed);
+    }
+    atomic_store(&trace_head, 0);
+}
+
+uint32_t ctx_trace_begin(void)
+{
+    ctx_trace_clock_t clock = atomic_load_explicit(&trace_clock, memory_order_relaxed);
+    return clock ? clock() : 0;
+}
+
+void ctx_trace_end(context_func_t func, uint32_t size, uint32_t start)
+{
+    ctx_trace_clock_t clock = atomic_load_explicit(&trace_clock, memory_order_relaxed);
+    if(!clock)
+    {
+        return;
+    }
+    uint32_t cycles = clock() - start;
+    // each writer has its own position, a lapped slot is simply overwritten
+    size_t pos = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_slot_t *slot = &trace_ring[pos & TRACE_MASK];
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->record = (ctx_trace_record_t){.func=func, .cycles=cycles, .size=size};
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);  // publish
+}
+
+size_t ctx_trace_read(ctx_trace_record_t *out, size_t max)
+{
+    size_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    size_t first = head > CTX_TRACE_DEPTH ? head - CTX_TRACE_DEPTH : 0;
+    size_t n = 0;
+    for(size_t pos=first; pos<head && n<max; pos++)
+    {
+        trace_slot_t *slot = &trace_ring[pos & TRACE_MASK];
+        if(atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        {
+            continue;   // not written yet or already lapped
+        }
+        out[n] = slot->record;
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&slot->seq, memory_order_relaxed) == pos + 1)
+        {
+            n++;    // unchanged while it was copied
+        }
+    }
+    return n;
+}
+
+size_t ctx_trace_aggregate(ctx_trace_summary_t *out, size_t max)
+{
+    static ctx_trace_record_t records[CTX_TRACE_DEPTH];  // too big for a small stack
+    size_t count = ctx_trace_read(records, CTX_TRACE_DEPTH);
+    size_t n = 0;
+    for(size_t r=0; r<count; r++)
+    {
+        size_t f = 0;
+        while(f < n && out[f].func != records[r].func)
+        {
+            f++;
+        }
+        if(f == n)
+        {
+            if(n == max)
+            {
+                continue;   // no room for another function
+            }
+            out[n++] = (ctx_trace_summary_t){.func=records[r].func};
+        }
+        out[f].calls++;
+        out[f].total_cycles += records[r].cycles;
+        if(records[r].cycles > out[f].max_cycles)
+        {
+            out[f].max_cycles = records[r].cycles;
+        }
+    }
+    for(size_t i=1; i<n; i++)  // insertion sort, n is small
+    {
+        ctx_trace_summary_t s = out[i];
+        size_t j = i;
+        for(; j > 0 && out[j-1].total_cycles < s.total_cycles; j--)
+        {
+            out[j] = out[j-1];
+        }
+        out[j] = s;
+    }
+    return n;
+}
+
+void ctx_trace_dump(int (*print)(const char *format, ...))
+{
+    ctx_trace_summary_t summary[CTX_TRACE_FUNCS];
+    size_t n = ctx_trace_aggregate(summary, CTX_TRACE_FUNCS);
+    print("%-18s %8s %12s %10s %10s\n", "function", "calls", "total", "mean", "max");
+    for(size_t i=0; i<n; i++)
+    {
+        print("%18p %8" PRIu32 " %12" PRIu64 " %10" PRIu64 " %10" PRIu32 "\n",
+              (void*)(uintptr_t)summary[i].func, summary[i].calls, summary[i].total_cycles,
+              summary[i].total_cycles / summary[i].calls, summary[i].max_cycles);
+    }
+}
+#endif
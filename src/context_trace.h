@@ -0,0 +1,109 @@
+/**
+ * @file context_trace.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief per-closure timing of run_context() and friends, built only with
+ *  CONTEXT_TRACE.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details Each traced run records the target function, the cycles it
+ *  took and the size of its block into a ring that keeps the most recent
+ *  CTX_TRACE_DEPTH runs.  The time source is supplied by the application:
+ * 
+ *  static uint32_t cycles(void) { return DWT->CYCCNT; }     // Cortex-M
+ *  static uint32_t cycles(void) { return (uint32_t)__rdtsc(); }  // x86
+ * 
+ *  ctx_trace_set_clock(cycles);
+ *  ...
+ *  ctx_trace_dump(printf);
+ * 
+ *  Durations are taken as the unsigned difference of two readings, so a
+ *  32 bit counter that wraps is fine as long as no one run is longer than
+ *  a full lap.  Without a clock nothing is recorded.  Built without
+ *  CONTEXT_TRACE the hooks in context.c compile to nothing.
+ */
+#ifndef CONTEXT_TRACE_H
+#define CONTEXT_TRACE_H
+#include <stdatomic.h>
+#include "context.h"
+
+#ifndef CTX_TRACE_DEPTH
+#define CTX_TRACE_DEPTH 256     // runs kept, must be a power of 2
+#endif
+
+#ifndef CTX_TRACE_FUNCS
+#define CTX_TRACE_FUNCS 16      // distinct functions ctx_trace_dump() reports
+#endif
+
+typedef uint32_t (*ctx_trace_clock_t)(void);
+
+typedef struct ctx_trace_record_t
+{
+    context_func_t func;
+    uint32_t cycles;
+    uint32_t size;      // bytes in the closure's block
+} ctx_trace_record_t;
+
+typedef struct ctx_trace_summary_t
+{
+    context_func_t func;
+    uint32_t calls;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+} ctx_trace_summary_t;
+
+/**
+ * @brief set the time source and start recording
+ * 
+ * @param clock returns a free running count, NULL stops recording
+ */
+void ctx_trace_set_clock(ctx_trace_clock_t clock);
+
+/**
+ * @brief forget every record
+ */
+void ctx_trace_reset(void);
+
+/**
+ * @brief hook before a traced call
+ * 
+ * @return uint32_t start time to hand to ctx_trace_end()
+ */
+uint32_t ctx_trace_begin(void);
+
+/**
+ * @brief hook after a traced call, safe from any thread or interrupt
+ * 
+ * @param func the function that ran
+ * @param size bytes in its block, read before the call in case it was freed
+ * @param start value ctx_trace_begin() returned
+ */
+void ctx_trace_end(context_func_t func, uint32_t size, uint32_t start);
+
+/**
+ * @brief copy out the most recent records, oldest first.  Records being
+ *  overwritten while they are read are skipped.
+ * 
+ * @param out filled with the records
+ * @param max capacity of out
+ * @return size_t number of records copied
+ */
+size_t ctx_trace_read(ctx_trace_record_t *out, size_t max);
+
+/**
+ * @brief total the records in the ring by function, most cycles first
+ * 
+ * @param out one entry per function
+ * @param max capacity of out, functions beyond it are dropped
+ * @return size_t number of functions filled in
+ */
+size_t ctx_trace_aggregate(ctx_trace_summary_t *out, size_t max);
+
+/**
+ * @brief print the aggregate, one line per function
+ * 
+ * @param print printf or anything like it
+ */
+void ctx_trace_dump(int (*print)(const char *format, ...));
+
+#endif // CONTEXT_TRACE_H
@@ -0,0 +1,98 @@
+/**
+ * @file context_typed.h
+ * @author Bryce Deary (bryce.deary@litegear.com)
+ * @brief generate the parameter struct, wrapper and constructor of a 
+ *  closure from one line.
+ * @date 2026-10-14
+ * 
+ * @copyright Copyright LightGear (2024)
+ * @details For a function that takes its parameters by value
+ * 
+ *  void blink_led(int pin, uint32_t period);
+ * 
+ *  DEFINE_CONTEXT(blink, blink_led, (int, pin), (uint32_t, period))
+ * 
+ *  at file scope generates
+ * 
+ *  typedef struct blink_args_t { int pin; uint32_t period; } blink_args_t;
+ *  static void blink_wrapper(context_blk_t *context);    // calls blink_led(pin, period)
+ *  static blink_args_t *blink_args(context_blk_t *context);
+ *  static context_blk_t *package_blink(int pin, uint32_t period);
+ * 
+ *  package_blink() stores its arguments straight into the closure as one
+ *  struct assignment of a size known at compile time, with no memcpy() and
+ *  no cast at the call site.  A static assert checks that the closure fits
+ *  CONTEXT_TYPED_BLOCKS blocks of CONTEXT_BLK_SIZE, DEFINE_CONTEXT_N() takes
+ *  the block count for one closure.  Up to 8 parameters.  The arguments
+ *  are not kept anywhere else, so the closure has no original parameters:
+ *  reset_context() leaves them as they are, set them again through
+ *  name_args() instead.
+ */
+#ifndef CONTEXT_TYPED_H
+#define CONTEXT_TYPED_H
+#include "context.h"
+
+#ifndef CONTEXT_TYPED_BLOCKS
+#define CONTEXT_TYPED_BLOCKS 1  // blocks a typed closure may take
+#endif
+
+#define CTX_PP_CAT(a, b) CTX_PP_CAT_(a, b)
+#define CTX_PP_CAT_(a, b) a##b
+#define CTX_PP_NARGS(...) CTX_PP_NARGS_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define CTX_PP_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define CTX_PP_APPLY(m, pair) m pair
+
+// m applied to each (type, name) pair, back to back
+#define CTX_MAP(m, ...) CTX_PP_CAT(CTX_MAP_, CTX_PP_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+#define CTX_MAP_1(m, p) CTX_PP_APPLY(m, p)
+#define CTX_MAP_2(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_1(m, __VA_ARGS__)
+#define CTX_MAP_3(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_2(m, __VA_ARGS__)
+#define CTX_MAP_4(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_3(m, __VA_ARGS__)
+#define CTX_MAP_5(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_4(m, __VA_ARGS__)
+#define CTX_MAP_6(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_5(m, __VA_ARGS__)
+#define CTX_MAP_7(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_6(m, __VA_ARGS__)
+#define CTX_MAP_8(m, p, ...) CTX_PP_APPLY(m, p) CTX_MAP_7(m, __VA_ARGS__)
+
+// the same, comma separated
+#define CTX_LIST(m, ...) CTX_PP_CAT(CTX_LIST_, CTX_PP_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+#define CTX_LIST_1(m, p) CTX_PP_APPLY(m, p)
+#define CTX_LIST_2(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_1(m, __VA_ARGS__)
+#define CTX_LIST_3(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_2(m, __VA_ARGS__)
+#define CTX_LIST_4(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_3(m, __VA_ARGS__)
+#define CTX_LIST_5(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_4(m, __VA_ARGS__)
+#define CTX_LIST_6(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_5(m, __VA_ARGS__)
+#define CTX_LIST_7(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_6(m, __VA_ARGS__)
+#define CTX_LIST_8(m, p, ...) CTX_PP_APPLY(m, p), CTX_LIST_7(m, __VA_ARGS__)
+
+#define CTX_FIELD(type, name) type name;
+#define CTX_PARAM(type, name) type name
+#define CTX_ARG(type, name) args->name
+#define CTX_INIT(type, name) .name = name
+
+#define DEFINE_CONTEXT(name, fn, ...) DEFINE_CONTEXT_N(name, fn, CONTEXT_TYPED_BLOCKS, __VA_ARGS__)
+
+#define DEFINE_CONTEXT_N(name, fn, blocks, ...)                                             \
+    typedef struct name##_args_t { CTX_MAP(CTX_FIELD, __VA_ARGS__) } name##_args_t;         \
+    _Static_assert(sizeof(context_blk_t) + sizeof(name##_args_t) <= (blocks) * CONTEXT_BLK_SIZE, \
+                   #name " parameters do not fit " #blocks " blocks");                       \
+    static inline name##_args_t *name##_args(context_blk_t *context)                        \
+    {                                                                                       \
+        return (name##_args_t*)context->user_context;                                       \
+    }                                                                                       \
+    static void name##_wrapper(context_blk_t *context)                                      \
+    {                                                                                       \
+        name##_args_t *args = name##_args(context);                                         \
+        fn(CTX_LIST(CTX_ARG, __VA_ARGS__));                                                 \
+    }                                                                                       \
+    static inline context_blk_t *package_##name(CTX_LIST(CTX_PARAM, __VA_ARGS__))          \
+    {                                                                                       \
+        context_blk_t *blk = package_context_ex(name##_wrapper, NULL, sizeof(name##_args_t), \
+                                                0, CTX_WS_ZERO_REQUESTED_ONLY);             \
+        if(blk)                                                                             \
+        {                                                                                   \
+            *name##_args(blk) = (name##_args_t){CTX_LIST(CTX_INIT, __VA_ARGS__)};           \
+        }                                                                                   \
+        return blk;                                                                         \
+    }
+
+#endif // CONTEXT_TYPED_H
@@ -2,6 +2,7 @@
 #include "unity.h"
 
 #include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
 
 void setUp(void)
 {
@@ -32,7 +33,8 @@ void test_package_context(void)
 
     context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
     #ifdef USE_MALLOC
-    TEST_ASSERT_EQUAL(56, blk->useable);
+    size_t total = (sizeof(context_blk_t)+sizeof my_struct + 56 + CONTEXT_HEAP_ALIGN - 1) & ~(size_t)(CONTEXT_HEAP_ALIGN - 1);
+    TEST_ASSERT_EQUAL(total - (sizeof(context_blk_t)+sizeof my_struct), blk->workspace_size);
     #else
     TEST_ASSERT_EQUAL(256 - (sizeof(context_blk_t)+sizeof my_struct), blk->workspace_size);
     #endif
@@ -41,6 +43,19 @@ void test_package_context(void)
 }
 
 
+void test_package_context_rejects_oversize(void)
+{
+    // more than the 16 bit header fields hold fails, whatever the pool
+    TEST_ASSERT_NULL(package_context(ctx_func, NULL, 70000, 0));
+    TEST_ASSERT_NULL(package_context_aligned(ctx_func, NULL, UINT16_MAX, 0, 64));
+    TEST_ASSERT_NULL(package_context_aligned(ctx_func, NULL, SIZE_MAX - 10, 0, 64));  // would wrap
+    TEST_ASSERT_NULL(package_context(ctx_func, NULL, 0, SIZE_MAX));
+#ifdef CONTEXT_COMPACT_HEADER
+    struct my_s_t my_struct = {4,3,2};
+    TEST_ASSERT_NULL(package_context(ctx_func, &my_struct, sizeof my_struct, 70000));
+#endif
+}
+
 void test_context_reuse(void)
 {
     struct my_s_t my_struct = {4,3,2};
@@ -55,3 +70,522 @@ void test_context_reuse(void)
     free_context_blk(blk);
 }
 
+
+
+#ifndef USE_MALLOC  // placement is up to the heap
+void test_first_fit_reuses_freed_run(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    context_blk_t *a = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    context_blk_t *b = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    context_blk_t *c = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_NOT_NULL(c);
+    free_context_blk(b);
+    // two blocks will not fit the hole left by b
+    context_blk_t *big = package_context(ctx_func, &my_struct, sizeof my_struct, 300);
+    TEST_ASSERT_NOT_NULL(big);
+    TEST_ASSERT_NOT_EQUAL(b, big);
+    // but one block will
+    context_blk_t *d = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_EQUAL_PTR(b, d);
+    free_context_blk(a);
+    free_context_blk(big);
+    free_context_blk(c);
+    free_context_blk(d);
+}
+#endif
+
+#if !defined(USE_MALLOC) && !defined(CONTEXT_SIZE_CLASSES) && !defined(CONTEXT_GROW)
+void test_pool_exhaustion(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blks[64];
+    int n = 0;
+
+    while(n < 64 && (blks[n] = package_context(ctx_func, &my_struct, sizeof my_struct, 56)) != NULL)
+    {
+        n++;
+    }
+    TEST_ASSERT_EQUAL(64, n);
+    TEST_ASSERT_NULL(package_context(ctx_func, &my_struct, sizeof my_struct, 56));
+    while(n--)
+    {
+        free_context_blk(blks[n]);
+    }
+    // whole pool is one free run again
+    context_blk_t *all = package_context(ctx_func, &my_struct, sizeof my_struct, 64*256 - (sizeof(context_blk_t) + sizeof my_struct));
+    TEST_ASSERT_NOT_NULL(all);
+    free_context_blk(all);
+}
+#endif
+
+#ifdef CONTEXT_LOCKFREE
+#include <pthread.h>
+
+#define STRESS_THREADS 4
+#define STRESS_LOOPS 20000
+
+static void *stress_producer(void *arg)
+{
+    uintptr_t id = (uintptr_t)arg;
+    for(int i=0; i<STRESS_LOOPS; i++)
+    {
+        struct my_s_t mine = {(uint32_t)id, i, 0};
+        // mix of one and two block closures
+        context_blk_t *blk = package_context(ctx_func, &mine, sizeof mine, (i & 1) ? 56 : 300);
+        if(blk == NULL)
+        {
+            continue;  // pool momentarily full
+        }
+        struct my_s_t *held = (struct my_s_t *)blk->user_context;
+        if(held->u1 != id || held->u2 != i)
+        {
+            return (void*)1;  // someone else owns our block
+        }
+        free_context_blk(blk);
+    }
+#ifdef CONTEXT_THREAD_CACHE
+    context_thread_cache_flush();
+#endif
+    return NULL;
+}
+
+void test_lockfree_concurrent_package_and_free(void)
+{
+    pthread_t threads[STRESS_THREADS];
+    void *result;
+
+    for(uintptr_t t=0; t<STRESS_THREADS; t++)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[t], NULL, stress_producer, (void*)(t+1)));
+    }
+    for(int t=0; t<STRESS_THREADS; t++)
+    {
+        pthread_join(threads[t], &result);
+        TEST_ASSERT_NULL(result);
+    }
+    // nothing leaked, the whole pool is still one free run
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *all = package_context(ctx_func, &my_struct, sizeof my_struct, 64*256 - (sizeof(context_blk_t) + sizeof my_struct));
+    TEST_ASSERT_NOT_NULL(all);
+    free_context_blk(all);
+}
+#endif
+
+static char batch_trace[16];
+static int batch_len;
+
+void batch_a(context_blk_t *context)
+{
+    batch_trace[batch_len++] = 'a' + ((uint8_t*)context->user_context)[0];
+}
+
+void batch_b(context_blk_t *context)
+{
+    batch_trace[batch_len++] = 'A' + ((uint8_t*)context->user_context)[0];
+}
+
+void test_run_context_batch(void)
+{
+    context_blk_t *blks[6];
+    context_func_t funcs[6] = {batch_a, batch_a, batch_b, batch_a, batch_b, batch_b};
+
+    batch_len = 0;
+    for(uint8_t i=0; i<6; i++)
+    {
+        blks[i] = package_context(funcs[i], &i, sizeof i, i == 3 ? 300 : 0);
+        TEST_ASSERT_NOT_NULL(blks[i]);
+    }
+    run_context_batch(blks, 6, 1);
+    // order is kept across the grouping
+    TEST_ASSERT_EQUAL(6, batch_len);
+    TEST_ASSERT_EQUAL_STRING_LEN("abCdEF", batch_trace, 6);
+#if !defined(USE_MALLOC) && !defined(CONTEXT_SIZE_CLASSES)
+    // all blocks returned in the one update
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *all = package_context(ctx_func, &my_struct, sizeof my_struct, 64*256 - (sizeof(context_blk_t) + sizeof my_struct));
+    TEST_ASSERT_NOT_NULL(all);
+    free_context_blk(all);
+#endif
+}
+
+void inline_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_EQUAL(0, context->workspace_size);
+    my_struct->u2++;
+}
+
+void test_inline_context_by_value(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_inline_t queue[2];
+
+    queue[0] = package_context_inline(inline_func, &my_struct, sizeof my_struct);
+    queue[1] = queue[0];  // copies are independent closures
+    run_context_inline(&queue[0]);
+    run_context_inline(&queue[0]);
+    run_context_inline(&queue[1]);
+    TEST_ASSERT_EQUAL(5, ((struct my_s_t *)queue[0].user_context)->u2);
+    TEST_ASSERT_EQUAL(4, ((struct my_s_t *)queue[1].user_context)->u2);
+    TEST_ASSERT_EQUAL(3, my_struct.u2);
+}
+
+#ifndef USE_MALLOC  // needs the freed block back
+void test_package_context_ex_workspace_modes(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    memset(context_workspace(blk), 0xA5, blk->workspace_size);
+    free_context_blk(blk);
+
+    // the same block comes back, only the requested 8 bytes are cleared
+    blk = package_context_ex(ctx_func, &my_struct, sizeof my_struct, 8, CTX_WS_ZERO_REQUESTED_ONLY);
+    uint8_t *ws = context_workspace(blk);
+    TEST_ASSERT_EQUAL(8, blk->workspace_request);
+    TEST_ASSERT_EQUAL(0, ws[0]);
+    TEST_ASSERT_EQUAL(0, ws[7]);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[8]);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[blk->workspace_size-1]);
+    free_context_blk(blk);
+
+    blk = package_context_ex(ctx_func, &my_struct, sizeof my_struct, 8, CTX_WS_UNINIT);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ((uint8_t*)context_workspace(blk))[8]);
+    free_context_blk(blk);
+}
+#endif
+
+void test_reset_and_refresh_copy_only_parameters(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    struct my_s_t update = {4,10,11};
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 64);
+    uint8_t *ws = context_workspace(blk);
+
+    TEST_ASSERT_EQUAL(sizeof my_struct, context_params_size(blk));
+    memset(ws, 0xA5, blk->workspace_size);
+    refresh_context(blk, &update);
+    TEST_ASSERT_EQUAL(10, ((struct my_s_t *)blk->user_context)->u2);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[0]);  // the workspace is past the parameters
+    int32_t u2 = 20;
+    refresh_context_partial(blk, offsetof(struct my_s_t, u2), &u2, sizeof u2);
+    TEST_ASSERT_EQUAL(20, ((struct my_s_t *)blk->user_context)->u2);
+    TEST_ASSERT_EQUAL(11, ((struct my_s_t *)blk->user_context)->u3);
+#ifndef CONTEXT_NO_ORIGINAL
+    reset_context(blk);
+    TEST_ASSERT_EQUAL(3, ((struct my_s_t *)blk->user_context)->u2);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[0]);
+    reset_and_clear_context_ex(blk, CTX_WS_UNINIT);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[blk->workspace_size-1]);
+    reset_and_clear_context_ex(blk, CTX_WS_ZERO_REQUESTED_ONLY);
+    TEST_ASSERT_EQUAL(0, ws[63]);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ws[64]);
+    reset_and_clear_context(blk);
+    TEST_ASSERT_EQUAL(0, ws[blk->workspace_size-1]);
+#endif
+    refresh_and_clear_context_ex(blk, &update, CTX_WS_ZERO_REQUESTED_ONLY);
+    TEST_ASSERT_EQUAL(10, ((struct my_s_t *)blk->user_context)->u2);
+    free_context_blk(blk);
+}
+
+void test_package_context_aligned(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    size_t aligns[] = {16, 32, 64};
+
+    for(int i=0; i<3; i++)
+    {
+        context_blk_t *blk = package_context_aligned(ctx_func, &my_struct, sizeof my_struct, 64, aligns[i]);
+        TEST_ASSERT_NOT_NULL(blk);
+        TEST_ASSERT_EQUAL(0, (uintptr_t)context_workspace(blk) % aligns[i]);
+        TEST_ASSERT_TRUE(blk->workspace_size >= 64);
+        TEST_ASSERT_EQUAL(sizeof my_struct, context_params_size(blk));
+        TEST_ASSERT_EQUAL_PTR((uint8_t*)blk + blk->size, (uint8_t*)context_workspace(blk) + blk->workspace_size);
+        run_context(blk);
+        free_context_blk(blk);
+    }
+#ifndef USE_MALLOC
+    // built in pool blocks start on a cache line
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)blk % CONTEXT_CACHE_LINE);
+    free_context_blk(blk);
+#endif
+}
+
+void test_named_pool(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, 4) / sizeof(uint64_t)];
+    context_pool_t pool;
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blks[4];
+
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 128, 4));
+    for(int i=0; i<4; i++)
+    {
+        blks[i] = package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0);
+        TEST_ASSERT_NOT_NULL(blks[i]);
+        TEST_ASSERT_EQUAL(128, blks[i]->size);
+        TEST_ASSERT_TRUE((uint8_t*)blks[i] >= (uint8_t*)memory && (uint8_t*)blks[i] < (uint8_t*)memory + sizeof memory);
+    }
+    TEST_ASSERT_NULL(package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0));
+    // the default pool is untouched
+    context_blk_t *other = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_NOT_NULL(other);
+#ifndef USE_MALLOC
+    TEST_ASSERT_EQUAL(256, other->size);
+#endif
+    free_context_blk(other);
+    // free finds the owning pool from the header
+    free_context_blk(blks[2]);
+    TEST_ASSERT_EQUAL_PTR(blks[2], package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0));
+    // two blocks fit once two neighbours are free
+    free_context_blk(blks[0]);
+    free_context_blk(blks[1]);
+    context_blk_t *wide = package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 150);
+    TEST_ASSERT_EQUAL_PTR(blks[0], wide);
+    TEST_ASSERT_EQUAL(256, wide->size);
+    free_context_blk(wide);
+    free_context_blk(blks[2]);
+    free_context_blk(blks[3]);
+    context_pool_deinit(&pool);
+}
+
+#ifdef CONTEXT_CHAINS
+static uint32_t chain_result;
+
+static void stage_double(context_blk_t *context)
+{
+    uint32_t *value = (uint32_t*)context->user_context;
+    if(context_upstream(context))
+    {
+        *value = *(uint32_t*)context_upstream(context)->user_context;  // read in place
+    }
+    *value *= 2;
+    chain_result = *value;
+}
+
+void test_run_context_chain(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, 3) / sizeof(uint64_t)];
+    context_pool_t pool;
+    uint32_t seed = 3;
+    context_blk_t *stages[3];
+
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 128, 3));
+    for(int i=0; i<3; i++)
+    {
+        stages[i] = package_context_in(&pool, stage_double, &seed, sizeof seed, 0);
+    }
+    TEST_ASSERT_EQUAL_PTR(stages[2], context_then(context_then(stages[0], stages[1]), stages[2]));
+    run_context_chain(stages[0]);
+    // each stage doubled the output of the one before
+    TEST_ASSERT_EQUAL(24, chain_result);
+    // every stage went back to the pool
+    for(int i=0; i<3; i++)
+    {
+        stages[i] = package_context_in(&pool, stage_double, &seed, sizeof seed, 0);
+        TEST_ASSERT_NOT_NULL(stages[i]);
+    }
+    // a lone closure runs and frees like run_context_and_free()
+    run_context_chain(stages[0]);
+    TEST_ASSERT_EQUAL(6, chain_result);
+    TEST_ASSERT_EQUAL_PTR(stages[0], package_context_in(&pool, stage_double, &seed, sizeof seed, 0));
+    for(int i=0; i<3; i++)
+    {
+        free_context_blk(stages[i]);
+    }
+    context_pool_deinit(&pool);
+}
+#endif
+
+#ifdef CONTEXT_REFCOUNT
+void test_refcount_requeue_without_alloc(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(256, 1) / sizeof(uint64_t)];
+    context_pool_t pool;
+    struct my_s_t my_struct = {4,3,2};
+
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 256, 1));
+    context_blk_t *blk = package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0);
+    TEST_ASSERT_EQUAL(1, context_refs(blk));
+    for(int period=0; period<3; period++)
+    {
+        TEST_ASSERT_EQUAL_PTR(blk, context_retain(blk));  // one for the queue
+        TEST_ASSERT_EQUAL(2, context_refs(blk));
+        run_context_and_release(blk);
+        TEST_ASSERT_EQUAL(1, context_refs(blk));
+    }
+    TEST_ASSERT_EQUAL(6, ((struct my_s_t *)blk->user_context)->u2);
+    // the last release frees
+    context_release(blk);
+    TEST_ASSERT_EQUAL_PTR(blk, package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0));
+    free_context_blk(blk);
+    context_pool_deinit(&pool);
+}
+#endif
+
+#ifdef CONTEXT_COMPLETION
+#include <pthread.h>
+
+static context_blk_t *done_seen;
+
+static void on_done(context_blk_t *context)
+{
+    TEST_ASSERT_FALSE(context_is_done(context));  // the callback comes first
+    done_seen = context;
+}
+
+static void *late_runner(void *arg)
+{
+    run_context((context_blk_t *)arg);
+    return NULL;
+}
+
+void test_completion_wait_and_callback(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 60);
+    TEST_ASSERT_FALSE(context_is_done(blk));
+    context_on_done(blk, on_done);
+    run_context(blk);
+    TEST_ASSERT_TRUE(context_is_done(blk));
+    TEST_ASSERT_EQUAL_PTR(blk, done_seen);
+    // submitted again, the result is published to the waiting thread
+    context_rearm(blk);
+    context_on_done(blk, NULL);
+    TEST_ASSERT_FALSE(context_is_done(blk));
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, late_runner, blk));
+    context_wait(blk);
+    TEST_ASSERT_EQUAL(5, ((struct my_s_t *)blk->user_context)->u2);
+    pthread_join(thread, NULL);
+    free_context_blk(blk);
+}
+#endif
+
+#ifdef CONTEXT_WIRE
+static void wire_unlisted(context_blk_t *context)
+{
+}
+
+void test_export_import_between_pools(void)
+{
+    static uint64_t remote_memory[CONTEXT_POOL_MEMORY(192, 4) / sizeof(uint64_t)];
+    static const context_func_t funcs[] = {wire_unlisted, ctx_func};
+    context_pool_t remote;
+    struct my_s_t my_struct = {4,3,2};
+    context_wire_t wire;
+
+    context_wire_table(funcs, 2);
+    TEST_ASSERT_EQUAL(1, context_pool_init(&remote, remote_memory, 192, 4));
+    context_blk_t *blk = package_context_ex(ctx_func, &my_struct, sizeof my_struct, 60, CTX_WS_UNINIT);
+    memset(context_workspace(blk), 0xA5, 60);
+    TEST_ASSERT_EQUAL(1, context_export(blk, &wire));
+    TEST_ASSERT_EQUAL(1, wire.func);
+    TEST_ASSERT_EQUAL(sizeof my_struct + 60, context_wire_payload(&wire));
+    // the payload goes straight into the remote block, as a DMA would
+    context_blk_t *copy = context_import_reserve(&remote, &wire);
+    TEST_ASSERT_NOT_NULL(copy);
+    memcpy(copy->user_context, blk->user_context, context_wire_payload(&wire));
+    TEST_ASSERT_EQUAL_PTR(copy, context_import(copy, &wire));
+    TEST_ASSERT_EQUAL(remote.id, copy->pool);
+    TEST_ASSERT_EQUAL(192, copy->size);
+    TEST_ASSERT_EQUAL(60, copy->workspace_request);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, ((uint8_t*)context_workspace(copy))[59]);
+    run_context(copy);
+    TEST_ASSERT_EQUAL(4, ((struct my_s_t *)copy->user_context)->u2);
+    // out of table functions and indexes are refused
+    wire.func = 2;
+    TEST_ASSERT_NULL(context_import(copy, &wire));
+    context_wire_table(funcs, 1);
+    TEST_ASSERT_EQUAL(0, context_export(blk, &wire));
+    free_context_blk(copy);
+    free_context_blk(blk);
+    context_pool_deinit(&remote);
+}
+#endif
+
+void test_arena_bump_and_reset(void)
+{
+    static uint64_t memory[64];
+    context_arena_t arena;
+    struct my_s_t my_struct = {4,3,2};
+
+    context_arena_init(&arena, memory, sizeof memory);
+    context_blk_t *a = package_context_arena(&arena, ctx_func, &my_struct, sizeof my_struct, 5);
+    context_blk_t *b = package_context_arena(&arena, ctx_func, &my_struct, sizeof my_struct, 64);
+    TEST_ASSERT_EQUAL_PTR(memory, a);
+    // packed back to back, 8 byte aligned
+    TEST_ASSERT_EQUAL(0, a->size % 8);
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)a + a->size, b);
+    run_context_and_free(b);  // free is a no-op, b stays in the arena
+    TEST_ASSERT_EQUAL(4, ((struct my_s_t *)b->user_context)->u2);
+    TEST_ASSERT_NULL(package_context_arena(&arena, ctx_func, &my_struct, sizeof my_struct, sizeof memory));
+    context_arena_reset(&arena);
+    TEST_ASSERT_EQUAL_PTR(a, package_context_arena(&arena, ctx_func, &my_struct, sizeof my_struct, 0));
+}
+
+void test_template_clone(void)
+{
+    static const struct my_s_t defaults = {4,3,2};
+    struct my_s_t changed = {4,7,9};
+    context_template_t tmpl;
+
+    TEST_ASSERT_EQUAL(1, context_template_init(&tmpl, NULL, ctx_func, &defaults, sizeof defaults, 64, CTX_WS_ZERO_ALL));
+    context_blk_t *a = context_clone(&tmpl, &changed);
+    context_blk_t *b = context_clone(&tmpl, NULL);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL(tmpl.total, a->size);
+    TEST_ASSERT_EQUAL(7, ((struct my_s_t *)a->user_context)->u2);
+    TEST_ASSERT_EQUAL(3, ((struct my_s_t *)b->user_context)->u2);
+    // each clone has its own workspace, cleared as the template asked
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)b->user_context + sizeof defaults, context_workspace(b));
+    TEST_ASSERT_EQUAL(0, ((uint8_t*)context_workspace(b))[63]);
+    run_context(a);
+    TEST_ASSERT_EQUAL(8, ((struct my_s_t *)a->user_context)->u2);
+#ifndef CONTEXT_NO_ORIGINAL
+    reset_context(a);  // back to the template values
+    TEST_ASSERT_EQUAL(3, ((struct my_s_t *)a->user_context)->u2);
+#endif
+    free_context_blk(a);
+    free_context_blk(b);
+}
+
+#ifdef CONTEXT_STATS
+void test_pool_stats(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, 8) / sizeof(uint64_t)];
+    context_pool_t pool;
+    context_pool_stats_t stats;
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blks[4];
+
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 128, 8));
+    for(int i=0; i<4; i++)
+    {
+        blks[i] = package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 2*128 - sizeof(context_blk_t) - sizeof my_struct);  // two blocks each
+    }
+    TEST_ASSERT_NULL(package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 0));
+    // two blocks freed in the middle, not enough for three
+    free_context_blk(blks[1]);
+    TEST_ASSERT_NULL(package_context_in(&pool, ctx_func, &my_struct, sizeof my_struct, 3*128 - sizeof(context_blk_t) - sizeof my_struct));
+    context_pool_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(6, stats.blocks_in_use);
+    TEST_ASSERT_EQUAL(8, stats.peak_blocks_in_use);
+    TEST_ASSERT_EQUAL(2, stats.largest_free_run);
+    TEST_ASSERT_EQUAL(4, stats.allocations);
+    TEST_ASSERT_EQUAL(1, stats.alloc_failures[0]);  // one block
+    TEST_ASSERT_EQUAL(1, stats.alloc_failures[1]);  // three blocks
+    TEST_ASSERT_EQUAL(4, stats.scan_cost[0]);       // each found the first free run
+    free_context_blk(blks[0]);
+    free_context_blk(blks[2]);
+    free_context_blk(blks[3]);
+    context_pool_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(0, stats.blocks_in_use);
+    TEST_ASSERT_EQUAL(8, stats.largest_free_run);
+    context_pool_deinit(&pool);
+}
+#endif
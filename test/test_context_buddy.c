@@ -0,0 +1,54 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct my_s_t{
+    uint32_t u1;
+    int32_t u2;
+    uint16_t u3;
+};
+
+void ctx_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_GREATER_THAN(56, context->workspace_size);
+    TEST_ASSERT_EQUAL(4, my_struct->u1);
+    my_struct->u2++;
+}
+
+#ifdef USE_BUDDY
+void test_buddy_rounds_and_coalesces(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    // three blocks come back as four, aligned to four
+    context_blk_t *three = package_context(ctx_func, &my_struct, sizeof my_struct, 600);
+    TEST_ASSERT_EQUAL(4*256, three->size);
+    context_blk_t *one = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_EQUAL(256, one->size);
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)three + 4*256, one);  // split from the run after it
+    context_blk_t *two = package_context(ctx_func, &my_struct, sizeof my_struct, 300);
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)three + 6*256, two);
+#ifndef CONTEXT_GROW  // it would go to a segment
+    // nothing larger than half the pool is left
+    TEST_ASSERT_NULL(package_context(ctx_func, &my_struct, sizeof my_struct, 33*256));
+#endif
+    free_context_blk(one);
+    free_context_blk(three);
+    free_context_blk(two);
+    // the buddies merged back into the whole pool
+    context_blk_t *all = package_context(ctx_func, &my_struct, sizeof my_struct, 64*256 - (sizeof(context_blk_t) + sizeof my_struct));
+    TEST_ASSERT_NOT_NULL(all);
+    TEST_ASSERT_EQUAL_PTR(three, all);
+    free_context_blk(all);
+}
+#endif
@@ -0,0 +1,107 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+#ifdef CONTEXT_THREAD_CACHE
+#include <pthread.h>
+#endif
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct my_s_t{
+    uint32_t u1;
+    int32_t u2;
+    uint16_t u3;
+};
+
+void ctx_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_GREATER_THAN(56, context->workspace_size);
+    TEST_ASSERT_EQUAL(4, my_struct->u1);
+    my_struct->u2++;
+}
+
+#ifdef CONTEXT_SIZE_CLASSES
+void test_size_class_slots(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    // three blocks worth rounds up to a four block slot
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 600);
+    TEST_ASSERT_NOT_NULL(blk);
+    TEST_ASSERT_EQUAL(4*256, blk->size);
+    TEST_ASSERT_EQUAL(4*256 - (sizeof(context_blk_t)+sizeof my_struct), blk->workspace_size);
+    free_context_blk(blk);
+    // same size class hands the slot straight back
+    context_blk_t *again = package_context(ctx_func, &my_struct, sizeof my_struct, 700);
+    TEST_ASSERT_EQUAL_PTR(blk, again);
+    free_context_blk(again);
+}
+
+void test_size_class_overflow_uses_space(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blks[32];
+    int n;
+
+    // more than all the one block slots, the rest spill to larger classes and space[]
+    for(n=0; n<32; n++)
+    {
+        blks[n] = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+        TEST_ASSERT_NOT_NULL(blks[n]);
+    }
+    // too big for any class
+    context_blk_t *big = package_context(ctx_func, &my_struct, sizeof my_struct, 8*256);
+    TEST_ASSERT_NOT_NULL(big);
+    free_context_blk(big);
+    while(n--)
+    {
+        free_context_blk(blks[n]);
+    }
+}
+#endif
+
+#ifdef CONTEXT_THREAD_CACHE
+static void *cache_user(void *arg)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    free_context_blk(blk);  // goes to this thread's magazine
+    context_thread_cache_flush();
+    *(context_blk_t**)arg = blk;
+    return NULL;
+}
+
+void test_thread_cache_flush_returns_slots(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *cached = NULL;
+    context_blk_t *blks[16];
+    int found = 0;
+    pthread_t thread;
+
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, cache_user, &cached));
+    pthread_join(thread, NULL);
+    TEST_ASSERT_NOT_NULL(cached);
+    // every one block slot is reachable again from this thread
+    for(int i=0; i<16; i++)
+    {
+        blks[i] = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+        found |= blks[i] == cached;
+    }
+    TEST_ASSERT_TRUE(found);
+    for(int i=0; i<16; i++)
+    {
+        free_context_blk(blks[i]);
+    }
+    context_thread_cache_flush();
+}
+#endif
@@ -0,0 +1,62 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct my_s_t{
+    uint32_t u1;
+    int32_t u2;
+    uint16_t u3;
+};
+
+void ctx_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_GREATER_THAN(56, context->workspace_size);
+    TEST_ASSERT_EQUAL(4, my_struct->u1);
+    my_struct->u2++;
+}
+
+#ifdef CONTEXT_COMPACT_HEADER
+void test_compact_header(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    size_t expected = sizeof(context_func_t);
+#ifndef CONTEXT_NO_ORIGINAL
+    expected += sizeof(void *);
+#endif
+#ifdef CONTEXT_CHAINS
+    expected += 2 * sizeof(context_blk_t *);
+#endif
+#ifdef CONTEXT_COMPLETION
+    expected += sizeof(context_func_t);
+#endif
+    size_t tail = 0;
+#ifdef CONTEXT_REFCOUNT
+    tail += sizeof(uint32_t);
+#endif
+#ifdef CONTEXT_PRIORITY
+    tail += sizeof(uint8_t);
+#endif
+#ifdef CONTEXT_COROUTINE
+    tail = ((tail + 1) & ~(size_t)1) + sizeof(uint16_t);
+#endif
+#ifdef CONTEXT_COMPLETION
+    tail += sizeof(uint8_t);
+#endif
+    expected += (tail + 7) & ~(size_t)7;  // padded to the user_context alignment
+    TEST_ASSERT_EQUAL(expected + 16, sizeof(context_blk_t));
+    context_blk_t *blk = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    // workspace follows the parameters
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)blk->user_context + sizeof my_struct, context_workspace(blk));
+    free_context_blk(blk);
+}
+#endif
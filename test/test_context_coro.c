@@ -0,0 +1,102 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+#ifdef CONTEXT_COROUTINE
+#include "context_coro.h"
+
+typedef struct counter_job_t
+{
+    int i;
+    int limit;
+    int sum;
+} counter_job_t;
+
+static int ready;
+
+static void counter_wrapper(context_blk_t *context)
+{
+    counter_job_t *job = (counter_job_t*)context->user_context;
+    CTX_CORO_BEGIN(context);
+    for(job->i = 0; job->i < job->limit; job->i++)
+    {
+        job->sum += job->i;
+        CTX_YIELD(context);
+    }
+    CTX_AWAIT(context, ready);
+    job->sum = -job->sum;
+    CTX_CORO_END(context);
+}
+#endif
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+#ifdef CONTEXT_COROUTINE
+void test_coro_yields_and_resumes(void)
+{
+    static const counter_job_t start = {.limit = 3};
+    context_blk_t *blk = package_context(counter_wrapper, &start, sizeof start, 0);
+    counter_job_t *job = (counter_job_t*)blk->user_context;
+
+    ready = 0;
+    run_context(blk);
+    TEST_ASSERT_EQUAL(0, job->sum);
+    run_context(blk);
+    run_context(blk);
+    TEST_ASSERT_EQUAL(3, job->sum);  // 0 + 1 + 2
+    run_context(blk);   // loop done, now waiting
+    run_context(blk);
+    TEST_ASSERT_FALSE(context_coro_done(blk));
+    TEST_ASSERT_EQUAL(3, job->sum);
+    ready = 1;
+    run_context(blk);
+    TEST_ASSERT_TRUE(context_coro_done(blk));
+    TEST_ASSERT_EQUAL(-3, job->sum);
+    run_context(blk);   // finished, nothing more
+    TEST_ASSERT_EQUAL(-3, job->sum);
+#ifndef CONTEXT_NO_ORIGINAL
+    // a reset starts over
+    reset_context(blk);
+    TEST_ASSERT_FALSE(context_coro_done(blk));
+    run_context(blk);
+    run_context(blk);
+    TEST_ASSERT_EQUAL(1, job->sum);
+#endif
+    free_context_blk(blk);
+}
+
+#ifdef CONTEXT_COMPLETION
+static int done_calls;
+
+static void count_done(context_blk_t *context)
+{
+    done_calls++;
+}
+
+void test_coro_completes_only_at_end(void)
+{
+    static const counter_job_t start = {.limit = 2};
+    context_blk_t *blk = package_context(counter_wrapper, &start, sizeof start, 0);
+
+    ready = 1;
+    done_calls = 0;
+    context_on_done(blk, count_done);
+    run_context(blk);
+    run_context(blk);
+    TEST_ASSERT_FALSE(context_is_done(blk));  // yielded, still running
+    TEST_ASSERT_EQUAL(0, done_calls);
+    run_context(blk);
+    TEST_ASSERT_TRUE(context_coro_done(blk));
+    TEST_ASSERT_TRUE(context_is_done(blk));
+    TEST_ASSERT_EQUAL(1, done_calls);
+    free_context_blk(blk);
+}
+#endif
+#endif
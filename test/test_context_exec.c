@@ -0,0 +1,137 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_queue.h"
+#include "context_exec.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+#ifdef CONTEXT_EXEC
+static ctx_exec_t exec;
+static atomic_int hits;
+#endif
+
+void setUp(void)
+{
+#ifdef CONTEXT_EXEC
+    atomic_store(&hits, 0);
+#endif
+}
+
+void tearDown(void)
+{
+}
+
+#ifdef CONTEXT_EXEC
+
+void hit_func(context_blk_t *context)
+{
+    atomic_fetch_add(&hits, *(int*)context->user_context);
+}
+
+// spawns children from inside a worker, they go onto its own deque
+void fan_out_func(context_blk_t *context)
+{
+    int one = 1;
+    for(int i=0; i<*(int*)context->user_context; i++)
+    {
+        context_blk_t *child;
+        while((child = package_context(hit_func, &one, sizeof one, 0)) == NULL)
+        {
+        }
+        TEST_ASSERT_EQUAL(1, ctx_exec_submit_and_free(&exec, child));
+    }
+}
+
+#if defined(CONTEXT_THREAD_CACHE) && !defined(CONTEXT_GROW)
+/**
+ * @brief take every closure the pool can give this thread, then free them
+ * 
+ * @return int how many there were
+ */
+static int pool_capacity(void)
+{
+    context_blk_t *all[256];
+    int n = 0;
+    context_thread_cache_flush();
+    while(n < 256 && (all[n] = package_context(hit_func, NULL, 0, 0)) != NULL)
+    {
+        n++;
+    }
+    free_context_batch(all, (size_t)n);
+    context_thread_cache_flush();
+    return n;
+}
+
+// first, so no earlier test has stranded a slot already
+void test_exec_stop_leaves_no_cached_slots(void)
+{
+    int zero = 0;
+    int capacity = pool_capacity();
+    TEST_ASSERT_EQUAL(1, ctx_exec_start(&exec, 4));
+    for(int i=0; i<1000; i++)
+    {
+        context_blk_t *blk;
+        while((blk = package_context(hit_func, &zero, sizeof zero, 0)) == NULL)
+        {
+        }
+        while(!ctx_exec_submit_and_free(&exec, blk))
+        {
+        }
+    }
+    ctx_exec_stop(&exec);
+    // the slots the workers freed are back on the shared lists
+    TEST_ASSERT_EQUAL(capacity, pool_capacity());
+}
+#endif
+
+void test_exec_runs_and_frees(void)
+{
+    int one = 1;
+    TEST_ASSERT_EQUAL(1, ctx_exec_start(&exec, 4));
+    for(int i=0; i<1000; i++)
+    {
+        context_blk_t *blk;
+        while((blk = package_context(hit_func, &one, sizeof one, 0)) == NULL)
+        {
+        }
+        while(!ctx_exec_submit_and_free(&exec, blk))
+        {
+        }
+    }
+    ctx_exec_wait_idle(&exec);
+    TEST_ASSERT_EQUAL(1000, atomic_load(&hits));
+    ctx_exec_stop(&exec);
+}
+
+void test_exec_submit_keeps_ownership(void)
+{
+    int three = 3;
+    context_blk_t *blk = package_context(hit_func, &three, sizeof three, 0);
+    TEST_ASSERT_EQUAL(1, ctx_exec_start(&exec, 2));
+    TEST_ASSERT_EQUAL(1, ctx_exec_submit(&exec, blk));
+    ctx_exec_wait_idle(&exec);
+    TEST_ASSERT_EQUAL(1, ctx_exec_submit(&exec, blk));
+    ctx_exec_stop(&exec);
+    TEST_ASSERT_EQUAL(6, atomic_load(&hits));
+    free_context_blk(blk);
+}
+
+void test_exec_nested_submit(void)
+{
+    int children = 20;
+    TEST_ASSERT_EQUAL(1, ctx_exec_start(&exec, 3));
+    for(int i=0; i<10; i++)
+    {
+        TEST_ASSERT_EQUAL(1, ctx_exec_submit_and_free(&exec, package_context(fan_out_func, &children, sizeof children, 0)));
+    }
+    ctx_exec_wait_idle(&exec);
+    TEST_ASSERT_EQUAL(200, atomic_load(&hits));
+    ctx_exec_stop(&exec);
+}
+
+void test_exec_rejects_bad_worker_count(void)
+{
+    TEST_ASSERT_EQUAL(0, ctx_exec_start(&exec, 0));
+    TEST_ASSERT_EQUAL(0, ctx_exec_start(&exec, CTX_EXEC_MAX_WORKERS + 1));
+}
+#endif // CONTEXT_EXEC
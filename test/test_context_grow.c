@@ -0,0 +1,72 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct my_s_t{
+    uint32_t u1;
+    int32_t u2;
+    uint16_t u3;
+};
+
+void ctx_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_GREATER_THAN(56, context->workspace_size);
+    TEST_ASSERT_EQUAL(4, my_struct->u1);
+    my_struct->u2++;
+}
+
+#ifdef CONTEXT_GROW
+#include <stdlib.h>
+
+static int segments_taken, segments_given;
+
+static void *counting_segment_alloc(size_t size)
+{
+    segments_taken++;
+    return aligned_alloc(CONTEXT_CACHE_LINE, size);
+}
+
+static void counting_segment_free(void *ptr, size_t size)
+{
+    segments_given++;
+    TEST_ASSERT_EQUAL(CONTEXT_SEGMENT_BLKS * CONTEXT_BLK_SIZE, size);
+    free(ptr);
+}
+
+void test_pool_grows_by_segments_and_trims(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+    context_blk_t *blks[512];
+    int n = 0;
+
+    context_pool_trim();  // start with no segments
+    context_set_segment_heap(counting_segment_alloc, counting_segment_free);
+    // fill the built in pool until a closure spills into a segment
+    do
+    {
+        blks[n] = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+        TEST_ASSERT_NOT_NULL(blks[n]);
+    } while(blks[n++]->pool == CONTEXT_POOL_DEFAULT && n < 511);
+    TEST_ASSERT_EQUAL(1, segments_taken);
+    context_blk_t *spilled = blks[n-1];
+    TEST_ASSERT_NOT_EQUAL(CONTEXT_POOL_DEFAULT, spilled->pool);
+    blks[n] = package_context(ctx_func, &my_struct, sizeof my_struct, 56);
+    TEST_ASSERT_EQUAL(spilled->pool, blks[n++]->pool);  // the segment with room is tried first
+    TEST_ASSERT_EQUAL(0, context_pool_trim());          // still in use
+    run_context_batch(blks, (size_t)n, 1);
+    TEST_ASSERT_EQUAL(1, context_pool_trim());
+    TEST_ASSERT_EQUAL(1, segments_given);
+    TEST_ASSERT_EQUAL(0, context_pool_trim());
+    context_set_segment_heap(NULL, NULL);
+}
+#endif
@@ -0,0 +1,59 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct my_s_t{
+    uint32_t u1;
+    int32_t u2;
+    uint16_t u3;
+};
+
+void ctx_func(context_blk_t *context)
+{
+    struct my_s_t *my_struct = (struct my_s_t *)context->user_context;
+    TEST_ASSERT_GREATER_THAN(56, context->workspace_size);
+    TEST_ASSERT_EQUAL(4, my_struct->u1);
+    my_struct->u2++;
+}
+
+#ifdef USE_MALLOC
+#include <stdlib.h>
+
+static size_t heap_allocated, heap_freed;
+
+static void *counting_alloc(size_t size)
+{
+    heap_allocated += size;
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, size_t size)
+{
+    heap_freed += size;
+    free(ptr);
+}
+
+void test_heap_hooks_get_sized_frees(void)
+{
+    struct my_s_t my_struct = {4,3,2};
+
+    context_set_heap(counting_alloc, counting_free);
+    context_blk_t *a = package_context(ctx_func, &my_struct, sizeof my_struct, 60);
+    context_blk_t *b = package_context(ctx_func, &my_struct, sizeof my_struct, 200);
+    TEST_ASSERT_EQUAL(a->size + b->size, heap_allocated);
+    TEST_ASSERT_EQUAL(0, a->size % CONTEXT_HEAP_ALIGN);
+    free_context_blk(a);
+    run_context_and_free(b);
+    TEST_ASSERT_EQUAL(heap_allocated, heap_freed);
+    context_set_heap(NULL, NULL);
+}
+#endif
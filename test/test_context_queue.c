@@ -0,0 +1,195 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_queue.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+static ctx_queue_t queue;
+static int runs;
+
+void setUp(void)
+{
+    runs = 0;
+}
+
+void tearDown(void)
+{
+}
+
+struct my_q_t{
+    uint32_t producer;
+    uint32_t seq;
+};
+
+void count_func(context_blk_t *context)
+{
+    (void)context;
+    runs++;
+}
+
+void test_queue_fifo_order(void)
+{
+    ctx_queue_init(&queue, CTX_QUEUE_SPSC);
+    context_blk_t *a = package_context(count_func, NULL, 0, 0);
+    context_blk_t *b = package_context(count_func, NULL, 0, 0);
+
+    TEST_ASSERT_NULL(ctx_queue_pop(&queue));
+    TEST_ASSERT_EQUAL(1, ctx_queue_push(&queue, a));
+    TEST_ASSERT_EQUAL(1, ctx_queue_push(&queue, b));
+    TEST_ASSERT_EQUAL_PTR(a, ctx_queue_pop(&queue));
+    TEST_ASSERT_EQUAL_PTR(b, ctx_queue_pop(&queue));
+    TEST_ASSERT_NULL(ctx_queue_pop(&queue));
+    free_context_blk(a);
+    free_context_blk(b);
+}
+
+void test_queue_full_keeps_ownership(void)
+{
+    ctx_queue_init(&queue, CTX_QUEUE_MPSC);
+    context_blk_t *blk = package_context(count_func, NULL, 0, 0);
+
+    for(int i=0; i<CTX_QUEUE_DEPTH; i++)
+    {
+        TEST_ASSERT_EQUAL(1, ctx_queue_push(&queue, blk));
+    }
+    TEST_ASSERT_EQUAL(0, ctx_queue_push(&queue, blk));
+    // the same closure queued DEPTH times, run without freeing
+    TEST_ASSERT_EQUAL(CTX_QUEUE_DEPTH, ctx_queue_drain(&queue, run_context));
+    TEST_ASSERT_EQUAL(CTX_QUEUE_DEPTH, runs);
+    TEST_ASSERT_EQUAL(1, ctx_queue_push(&queue, blk));
+    TEST_ASSERT_EQUAL(1, ctx_queue_drain(&queue, run_context_and_free));
+}
+
+void test_queue_padding(void)
+{
+    TEST_ASSERT_EQUAL(0, ((uintptr_t)&queue.tail) % CONTEXT_CACHE_LINE);
+    TEST_ASSERT_GREATER_OR_EQUAL(CONTEXT_CACHE_LINE, (uintptr_t)&queue.head - (uintptr_t)&queue.tail);
+    TEST_ASSERT_GREATER_OR_EQUAL(CONTEXT_CACHE_LINE, (uintptr_t)&queue.slots[0] - (uintptr_t)&queue.head);
+}
+
+#ifdef CONTEXT_LOCKFREE  // producers share the pool
+#include <pthread.h>
+
+#define PRODUCERS 3
+#define PER_PRODUCER 2000
+
+static uint32_t next_seq[PRODUCERS];
+static int out_of_order;
+
+void order_func(context_blk_t *context)
+{
+    struct my_q_t *msg = (struct my_q_t *)context->user_context;
+    if(msg->seq != next_seq[msg->producer])
+    {
+        out_of_order++;
+    }
+    next_seq[msg->producer] = msg->seq + 1;
+    runs++;
+}
+
+static void *producer(void *arg)
+{
+    struct my_q_t msg = {(uint32_t)(uintptr_t)arg, 0};
+    while(msg.seq < PER_PRODUCER)
+    {
+        context_blk_t *blk = package_context(order_func, &msg, sizeof msg, 0);
+        if(blk == NULL)
+        {
+            continue;  // pool is busy in the consumer, try again
+        }
+        while(!ctx_queue_push(&queue, blk))
+        {
+        }
+        msg.seq++;
+    }
+    return NULL;
+}
+
+void test_queue_mpsc_producers(void)
+{
+    pthread_t threads[PRODUCERS];
+
+    ctx_queue_init(&queue, CTX_QUEUE_MPSC);
+    for(uintptr_t t=0; t<PRODUCERS; t++)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[t], NULL, producer, (void*)t));
+    }
+    while(runs < PRODUCERS * PER_PRODUCER)
+    {
+        ctx_queue_drain(&queue, run_context_and_free);
+    }
+    for(int t=0; t<PRODUCERS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    // each producer's closures arrive in the order it pushed them
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    TEST_ASSERT_NULL(ctx_queue_pop(&queue));
+}
+#endif
+
+#ifdef CONTEXT_PRIORITY
+static ctx_prio_queue_t prio_queue;
+
+static context_blk_t *at_level(unsigned level)
+{
+    return package_context_ex(count_func, NULL, 0, 0, CTX_PRIO(level));
+}
+
+void test_prio_queue_most_urgent_first(void)
+{
+    ctx_prio_queue_init(&prio_queue, CTX_QUEUE_SPSC, 0);
+    context_blk_t *low = at_level(0);
+    context_blk_t *high = at_level(7);
+    context_blk_t *mid_a = at_level(3);
+    context_blk_t *mid_b = at_level(3);
+
+    TEST_ASSERT_NULL(ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL(3, context_priority(mid_a));
+    TEST_ASSERT_EQUAL(1, ctx_prio_queue_push(&prio_queue, low));
+    TEST_ASSERT_EQUAL(1, ctx_prio_queue_push(&prio_queue, mid_a));
+    TEST_ASSERT_EQUAL(1, ctx_prio_queue_push(&prio_queue, high));
+    TEST_ASSERT_EQUAL(1, ctx_prio_queue_push(&prio_queue, mid_b));
+    TEST_ASSERT_EQUAL_PTR(high, ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(mid_a, ctx_prio_queue_pop(&prio_queue));  // FIFO within a level
+    TEST_ASSERT_EQUAL_PTR(mid_b, ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(low, ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_NULL(ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL(0, atomic_load(&prio_queue.ready));
+    free_context_blk(low);
+    free_context_blk(high);
+    free_context_blk(mid_a);
+    free_context_blk(mid_b);
+}
+
+void test_prio_queue_starvation_guard(void)
+{
+    context_blk_t *urgent[8];
+    context_blk_t *low = at_level(0);
+    context_blk_t *mid = at_level(2);
+    ctx_prio_queue_init(&prio_queue, CTX_QUEUE_SPSC, 2);
+    for(int i=0; i<8; i++)
+    {
+        urgent[i] = at_level(5);
+        ctx_prio_queue_push(&prio_queue, urgent[i]);
+    }
+    ctx_prio_queue_push(&prio_queue, low);
+    ctx_prio_queue_push(&prio_queue, mid);
+
+    // two urgent, then the guard serves the lower levels in turn
+    TEST_ASSERT_EQUAL_PTR(urgent[0], ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(urgent[1], ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(mid, ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(urgent[2], ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(urgent[3], ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL_PTR(low, ctx_prio_queue_pop(&prio_queue));
+    TEST_ASSERT_EQUAL(4, ctx_prio_queue_drain(&prio_queue, run_context_and_free));
+    TEST_ASSERT_EQUAL(4, runs);
+    for(int i=0; i<4; i++)
+    {
+        free_context_blk(urgent[i]);
+    }
+    free_context_blk(low);
+    free_context_blk(mid);
+}
+#endif
@@ -0,0 +1,107 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_shm.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+#ifdef CONTEXT_SHM
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHM_POOL_ID 5
+
+static char shm_name[32];
+static context_pool_t shm_pool;
+#endif
+
+void setUp(void)
+{
+#ifdef CONTEXT_SHM
+    snprintf(shm_name, sizeof shm_name, "/ctx_test_%d", (int)getpid());
+#endif
+}
+
+void tearDown(void)
+{
+}
+
+#ifdef CONTEXT_SHM
+typedef struct job_t
+{
+    int value;
+    int result;
+} job_t;
+
+static void job_wrapper(context_blk_t *context)
+{
+    job_t *job = (job_t*)context->user_context;
+    job->result = job->value * 2;
+}
+
+void test_shm_pool_survives_reattach(void)
+{
+    TEST_ASSERT_EQUAL(1, context_shm_pool_open(&shm_pool, shm_name, 128, 16, SHM_POOL_ID));
+    TEST_ASSERT_EQUAL(SHM_POOL_ID, shm_pool.id);
+    context_blk_t *blk = package_context_in(&shm_pool, job_wrapper, &(job_t){.value=21}, sizeof(job_t), 0);
+    size_t offset = context_pool_offset(&shm_pool, blk);
+    context_shm_pool_close(&shm_pool, NULL);
+    // other geometries and ids are refused
+    TEST_ASSERT_EQUAL(0, context_shm_pool_open(&shm_pool, shm_name, 128, 8, SHM_POOL_ID));
+    TEST_ASSERT_EQUAL(0, context_shm_pool_open(&shm_pool, shm_name, 128, 16, SHM_POOL_ID + 1));
+    // attaching finds the closure and its block still taken
+    TEST_ASSERT_EQUAL(1, context_shm_pool_open(&shm_pool, shm_name, 128, 16, SHM_POOL_ID));
+    blk = context_pool_at(&shm_pool, offset);
+    TEST_ASSERT_NOT_NULL(blk);
+    TEST_ASSERT_NULL(context_pool_at(&shm_pool, offset + 8));
+    TEST_ASSERT_NOT_EQUAL(offset, context_pool_offset(&shm_pool, package_context_in(&shm_pool, job_wrapper, &(job_t){0}, sizeof(job_t), 0)));
+    run_context(blk);
+    TEST_ASSERT_EQUAL(42, ((job_t*)blk->user_context)->result);
+    context_shm_pool_close(&shm_pool, shm_name);
+}
+
+void test_shm_pool_other_process_packages(void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL(0, pipe(fds));
+    TEST_ASSERT_EQUAL(1, context_shm_pool_open(&shm_pool, shm_name, 128, 16, SHM_POOL_ID));
+    pid_t child = fork();
+    TEST_ASSERT_NOT_EQUAL(-1, child);
+    if(child == 0)
+    {
+        // producer, hands over offsets through the pipe
+        for(int i=0; i<4; i++)
+        {
+            context_blk_t *blk = package_context_in(&shm_pool, job_wrapper, &(job_t){.value=i}, sizeof(job_t), 0);
+            size_t offset = blk ? context_pool_offset(&shm_pool, blk) : (size_t)-1;
+            if(write(fds[1], &offset, sizeof offset) != sizeof offset)
+            {
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+    int sum = 0;
+    for(int i=0; i<4; i++)
+    {
+        size_t offset;
+        TEST_ASSERT_EQUAL(sizeof offset, read(fds[0], &offset, sizeof offset));
+        context_blk_t *blk = context_pool_at(&shm_pool, offset);
+        TEST_ASSERT_NOT_NULL(blk);
+        run_context(blk);
+        sum += ((job_t*)blk->user_context)->result;
+        free_context_blk(blk);  // freed by the executor, packaged by the producer
+    }
+    int status;
+    TEST_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+    TEST_ASSERT_EQUAL(0, WEXITSTATUS(status));
+    TEST_ASSERT_EQUAL(12, sum);
+    // every block is free again
+    context_blk_t *all = package_context_in(&shm_pool, job_wrapper, NULL, 0, 16 * 128 - sizeof(context_blk_t));
+    TEST_ASSERT_NOT_NULL(all);
+    free_context_blk(all);
+    close(fds[0]);
+    close(fds[1]);
+    context_shm_pool_close(&shm_pool, shm_name);
+}
+#endif // CONTEXT_SHM
@@ -0,0 +1,167 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_timer.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+static ctx_wheel_t wheel;
+static int runs;
+static uint32_t ran_at[8];
+
+void setUp(void)
+{
+    runs = 0;
+    ctx_wheel_init(&wheel, 0);
+}
+
+void tearDown(void)
+{
+}
+
+static void note_func(context_blk_t *context)
+{
+    (void)context;
+    if(runs < 8)
+    {
+        ran_at[runs] = wheel.now;
+    }
+    runs++;
+}
+
+static ctx_timer_t *cancelled;
+
+static void cancel_func(context_blk_t *context)
+{
+    note_func(context);
+    cancelled = *(ctx_timer_t**)context->user_context;
+    ctx_timer_cancel(&wheel, cancelled);
+}
+
+static void run_until(uint32_t tick)
+{
+    while(wheel.now != tick)
+    {
+        ctx_timer_tick(&wheel);
+    }
+}
+
+void test_timer_one_shot_runs_once_on_time(void)
+{
+    ctx_timer_t timer = CTX_TIMER_INIT;
+    context_blk_t *blk = package_context(note_func, NULL, 0, 0);
+    ctx_timer_start(&wheel, &timer, blk, 5, 0, 0);
+    TEST_ASSERT_EQUAL(1, ctx_timer_pending(&timer));
+    run_until(4);
+    TEST_ASSERT_EQUAL(0, runs);
+    TEST_ASSERT_EQUAL(1, ctx_timer_tick(&wheel));
+    TEST_ASSERT_EQUAL(5, ran_at[0]);
+    TEST_ASSERT_EQUAL(0, ctx_timer_pending(&timer));
+    run_until(200);
+    TEST_ASSERT_EQUAL(1, runs);
+    free_context_blk(blk);
+}
+
+void test_timer_cascades_far_timers(void)
+{
+    ctx_timer_t near, mid, far;
+    ctx_timer_init(&near);
+    ctx_timer_init(&mid);
+    ctx_timer_init(&far);
+    TEST_ASSERT_FALSE(ctx_timer_pending(&far));
+    context_blk_t *blk = package_context(note_func, NULL, 0, 0);
+    ctx_timer_start(&wheel, &far, blk, 300000, 0, 0);  // level 3
+    ctx_timer_start(&wheel, &mid, blk, 5000, 0, 0);    // level 2
+    ctx_timer_start(&wheel, &near, blk, 70, 0, 0);     // level 1
+    run_until(300000);
+    TEST_ASSERT_EQUAL(3, runs);
+    TEST_ASSERT_EQUAL(70, ran_at[0]);
+    TEST_ASSERT_EQUAL(5000, ran_at[1]);
+    TEST_ASSERT_EQUAL(300000, ran_at[2]);
+    free_context_blk(blk);
+}
+
+void test_timer_periodic_and_cancel(void)
+{
+    ctx_timer_t timer = CTX_TIMER_INIT;
+    context_blk_t *blk = package_context(note_func, NULL, 0, 0);
+    ctx_timer_start(&wheel, &timer, blk, 10, 100, 0);
+    run_until(310);
+    TEST_ASSERT_EQUAL(4, runs);
+    TEST_ASSERT_EQUAL(110, ran_at[1]);
+    TEST_ASSERT_EQUAL(310, ran_at[3]);
+    ctx_timer_cancel(&wheel, &timer);
+    TEST_ASSERT_EQUAL(0, ctx_timer_pending(&timer));
+    run_until(1000);
+    TEST_ASSERT_EQUAL(4, runs);
+    free_context_blk(blk);
+}
+
+void test_timer_cancel_from_same_tick(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, 2) / sizeof(uint64_t)];
+    context_pool_t pool;
+    ctx_timer_t a = CTX_TIMER_INIT, b = CTX_TIMER_INIT;
+    ctx_timer_t *other_a = &b, *other_b = &a;
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 128, 2));
+    // due on the same tick, whichever runs first cancels the other
+    ctx_timer_start(&wheel, &a, package_context_in(&pool, cancel_func, &other_a, sizeof other_a, 0), 5, 0, CTX_TIMER_FREE);
+    ctx_timer_start(&wheel, &b, package_context_in(&pool, cancel_func, &other_b, sizeof other_b, 0), 5, 0, CTX_TIMER_FREE);
+    run_until(4);
+    TEST_ASSERT_EQUAL(1, ctx_timer_tick(&wheel));
+    TEST_ASSERT_EQUAL(1, runs);
+    TEST_ASSERT_FALSE(ctx_timer_pending(&a));
+    TEST_ASSERT_FALSE(ctx_timer_pending(&b));
+    // the one that ran was freed, the cancelled one is the caller's again
+    context_blk_t *blk = package_context_in(&pool, note_func, NULL, 0, 0);
+    TEST_ASSERT_NOT_NULL(blk);
+    TEST_ASSERT_NULL(package_context_in(&pool, note_func, NULL, 0, 0));
+    free_context_blk(blk);
+    free_context_blk(cancelled->blk);
+    context_pool_deinit(&pool);
+}
+
+void test_timer_batch_and_auto_free(void)
+{
+    static uint64_t memory[CONTEXT_POOL_MEMORY(128, CTX_TIMER_BATCH + 8) / sizeof(uint64_t)];
+    static ctx_timer_t timers[CTX_TIMER_BATCH + 8];
+    context_pool_t pool;
+    TEST_ASSERT_EQUAL(1, context_pool_init(&pool, memory, 128, CTX_TIMER_BATCH + 8));
+    for(int i=0; i<CTX_TIMER_BATCH + 8; i++)  // more than one batch due on the same tick
+    {
+        ctx_timer_start(&wheel, &timers[i], package_context_in(&pool, note_func, NULL, 0, 0), 3, 0, CTX_TIMER_FREE);
+    }
+    TEST_ASSERT_NULL(package_context_in(&pool, note_func, NULL, 0, 0));
+    run_until(3);
+    TEST_ASSERT_EQUAL(CTX_TIMER_BATCH + 8, runs);
+    // every one-shot went back to the pool
+    for(int i=0; i<CTX_TIMER_BATCH + 8; i++)
+    {
+        TEST_ASSERT_NOT_NULL(package_context_in(&pool, note_func, NULL, 0, 0));
+    }
+    context_pool_deinit(&pool);
+}
+
+void test_timer_wraps_tick_counter(void)
+{
+    ctx_timer_t timer = CTX_TIMER_INIT;
+    context_blk_t *blk = package_context(note_func, NULL, 0, 0);
+    ctx_wheel_init(&wheel, 0xFFFFFFF0u);
+    ctx_timer_start(&wheel, &timer, blk, 0x20, 0, 0);
+    run_until(0x10);
+    TEST_ASSERT_EQUAL(1, runs);
+    TEST_ASSERT_EQUAL(0x10, ran_at[0]);
+    free_context_blk(blk);
+}
+
+void test_timer_beyond_top_level(void)
+{
+    ctx_timer_t timer = CTX_TIMER_INIT;
+    context_blk_t *blk = package_context(note_func, NULL, 0, 0);
+    const uint32_t delay = (1u << (CTX_WHEEL_BITS * CTX_WHEEL_LEVELS)) + 1000;
+    ctx_timer_start(&wheel, &timer, blk, delay, 0, 0);
+    run_until(delay - 1);
+    TEST_ASSERT_EQUAL(0, runs);
+    run_until(delay);
+    TEST_ASSERT_EQUAL(1, runs);
+    free_context_blk(blk);
+}
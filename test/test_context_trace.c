@@ -0,0 +1,124 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_trace.h"
+
+#ifdef CONTEXT_TRACE
+static uint32_t now;
+static uint32_t step;
+
+static uint32_t fake_clock(void)
+{
+    return now += step;
+}
+#endif
+
+void setUp(void)
+{
+#ifdef CONTEXT_TRACE
+    now = 0;
+    step = 10;
+    ctx_trace_reset();
+    ctx_trace_set_clock(fake_clock);
+#endif
+}
+
+void tearDown(void)
+{
+#ifdef CONTEXT_TRACE
+    ctx_trace_set_clock(NULL);
+#endif
+}
+
+#ifdef CONTEXT_TRACE
+static void fast_func(context_blk_t *context)
+{
+    (void)context;
+}
+
+static void slow_func(context_blk_t *context)
+{
+    (void)context;
+    now += 1000;
+}
+
+void test_trace_records_each_run(void)
+{
+    context_blk_t *blk = package_context(slow_func, NULL, 0, 0);
+    size_t size = blk->size;
+    ctx_trace_record_t records[4];
+
+    run_context(blk);
+    run_context_and_free(blk);
+    TEST_ASSERT_EQUAL(2, ctx_trace_read(records, 4));
+    TEST_ASSERT_EQUAL_PTR(slow_func, records[0].func);
+    TEST_ASSERT_EQUAL(1010, records[0].cycles);
+    TEST_ASSERT_EQUAL(size, records[1].size);  // taken before the free
+}
+
+static context_blk_t *reused;
+
+static void self_free_func(context_blk_t *context)
+{
+    free_context_blk(context);
+    reused = package_context(fast_func, NULL, 0, 600);  // likely in the block just freed
+}
+
+void test_trace_closure_freeing_itself(void)
+{
+    context_blk_t *blk = package_context(self_free_func, NULL, 0, 0);
+    size_t size = blk->size;
+    ctx_trace_record_t record;
+
+    run_context(blk);
+    TEST_ASSERT_EQUAL(1, ctx_trace_read(&record, 1));
+    TEST_ASSERT_EQUAL_PTR(self_free_func, record.func);
+    TEST_ASSERT_EQUAL(size, record.size);
+    free_context_blk(reused);
+}
+
+void test_trace_no_clock_no_records(void)
+{
+    ctx_trace_record_t record;
+    ctx_trace_set_clock(NULL);
+    context_blk_t *blk = package_context(fast_func, NULL, 0, 0);
+    run_context_and_free(blk);
+    TEST_ASSERT_EQUAL(0, ctx_trace_read(&record, 1));
+}
+
+void test_trace_aggregate_by_function(void)
+{
+    context_blk_t *fast = package_context(fast_func, NULL, 0, 0);
+    context_blk_t *slow = package_context(slow_func, NULL, 0, 0);
+    ctx_trace_summary_t summary[2];
+
+    for(int i=0; i<3; i++)
+    {
+        run_context(fast);
+    }
+    run_context(slow);
+    TEST_ASSERT_EQUAL(2, ctx_trace_aggregate(summary, 2));
+    TEST_ASSERT_EQUAL_PTR(slow_func, summary[0].func);  // most cycles first
+    TEST_ASSERT_EQUAL(1, summary[0].calls);
+    TEST_ASSERT_EQUAL_PTR(fast_func, summary[1].func);
+    TEST_ASSERT_EQUAL(3, summary[1].calls);
+    TEST_ASSERT_EQUAL(30, summary[1].total_cycles);
+    TEST_ASSERT_EQUAL(10, summary[1].max_cycles);
+    // only room for one
+    TEST_ASSERT_EQUAL(1, ctx_trace_aggregate(summary, 1));
+    free_context_blk(fast);
+    free_context_blk(slow);
+}
+
+void test_trace_ring_keeps_latest(void)
+{
+    context_blk_t *blk = package_context(fast_func, NULL, 0, 0);
+    static ctx_trace_record_t records[CTX_TRACE_DEPTH];
+    for(int i=0; i<CTX_TRACE_DEPTH + 5; i++)
+    {
+        run_context(blk);
+    }
+    TEST_ASSERT_EQUAL(CTX_TRACE_DEPTH, ctx_trace_read(records, CTX_TRACE_DEPTH));
+    free_context_blk(blk);
+}
+#endif
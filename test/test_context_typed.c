@@ -0,0 +1,70 @@
+#include "unity.h"
+
+#include "context.h"
+#include "context_typed.h"
+#include "context_trace.h"  // linked for the CONTEXT_TRACE hooks in context.c
+
+static int last_pin;
+static uint32_t last_period;
+static int calls;
+
+void setUp(void)
+{
+    last_pin = 0;
+    last_period = 0;
+    calls = 0;
+}
+
+void tearDown(void)
+{
+}
+
+static void blink_led(int pin, uint32_t period)
+{
+    last_pin = pin;
+    last_period = period;
+    calls++;
+}
+
+static void count(int n)
+{
+    calls += n;
+}
+
+DEFINE_CONTEXT(blink, blink_led, (int, pin), (uint32_t, period))
+DEFINE_CONTEXT_N(tally, count, 2, (int, n))
+
+void test_typed_package_and_run(void)
+{
+    context_blk_t *blk = package_blink(13, 500);
+    TEST_ASSERT_NOT_NULL(blk);
+    TEST_ASSERT_EQUAL(13, blink_args(blk)->pin);
+    run_context(blk);
+    TEST_ASSERT_EQUAL(13, last_pin);
+    TEST_ASSERT_EQUAL(500, last_period);
+    // parameters can be changed in place between runs
+    blink_args(blk)->period = 250;
+    run_context_and_free(blk);
+    TEST_ASSERT_EQUAL(250, last_period);
+    TEST_ASSERT_EQUAL(2, calls);
+}
+
+void test_typed_single_parameter(void)
+{
+    context_blk_t *blk = package_tally(3);
+    TEST_ASSERT_EQUAL(sizeof(tally_args_t), sizeof(int));
+    run_context_and_free(blk);
+    TEST_ASSERT_EQUAL(3, calls);
+}
+
+#ifndef CONTEXT_NO_ORIGINAL
+void test_typed_reset_keeps_parameters(void)
+{
+    context_blk_t *blk = package_blink(7, 100);
+    blink_args(blk)->period = 200;
+    reset_and_run_context(blk);  // no original to copy from
+    TEST_ASSERT_EQUAL(7, last_pin);
+    TEST_ASSERT_EQUAL(200, last_period);
+    free_context_blk(blk);
+}
+#endif